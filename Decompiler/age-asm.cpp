@@ -1,93 +1,185 @@
-#include "age-shared.h"
-#include "disassembler.h"
-#include "reassembler.h"
+#include "async-io.h"
+#include "batch-stats.h"
+#include "build-cache.h"
+#include "content-hash.h"
+#include "corpus-bench.h"
+#include "libage.h"
+#include "scheduler.h"
+#include "trace.h"
 
 #include <iostream>
 #include <thread>
 #include <chrono>
 #include <fstream>
+#include <atomic>
+#include <charconv>
+#include <optional>
+#include <unordered_map>
 
 const std::size_t NUM_THREADS = std::max(std::thread::hardware_concurrency(), 4U);
-void doDisassemble();
-void doAssemble();
-void doCheckFile();
-void CheckFile(const std::filesystem::path& input);
 
-static std::vector<std::pair<const std::filesystem::path, const std::filesystem::path>> files;
+// Everything a worker reuses from one file to the next
+struct Worker_Scratch {
+    Output_Buffer first;
+    Output_Buffer second;
+    Scratch_Arena arena;
+};
+
+bool doDisassemble(const Batch_File& file, Worker_Scratch& scratch, Script_Stats* stats, Async_IO* io);
+bool doAssemble(const Batch_File& file, Worker_Scratch& scratch, Build_Cache* cache, Script_Stats* stats, Async_IO* io);
+
+struct Check_Result {
+    bool equal{true};
+    size_t first_difference{};
+    std::string location;
+};
+Check_Result CheckFile(const Batch_File& file, Worker_Scratch& scratch);
+int doExtract(const std::filesystem::path& index_path, const std::filesystem::path& output, std::string_view filter);
+int doDisassembleArchive(const std::filesystem::path& index_path, const std::filesystem::path& output);
+int doRepack(const std::filesystem::path& index_path, const std::filesystem::path& input_dir, const std::filesystem::path& output);
+bool doExtractStrings(const Batch_File& file, Worker_Scratch& scratch);
+bool doPatchStrings(const Batch_File& file, const std::filesystem::path& table, Worker_Scratch& scratch);
+
+static std::vector<Batch_File> files;
+
+// A whole decimal argument of at least 1, false for anything else
+static bool parse_count(std::string_view text, size_t& count) {
+    const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), count);
+    return ec == std::errc{} && end == text.data() + text.size() && count > 0;
+}
 
-int main(s32 argc, char** argv) {
+int main(s32 argc, char** argv) try {
     if (argc < 3) {
         fprintf(stderr, "AGE script utilities by Maide\n");
         fprintf(stderr, "Originally written by Kellindil\n\n");
-        fprintf(stderr, "Usage: %s [-da] infile [outfile]\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-dax] infile [outfile]\n", argv[0]);
+        fprintf(stderr, "       %s [-da] indir [outdir] --stats [stats.json|stats.csv]\n", argv[0]);
+        fprintf(stderr, "       %s [-da] indir [outdir] --trace trace.json\n", argv[0]);
+        fprintf(stderr, "       %s [-da] indir [outdir] --io uring|threads|sync\n", argv[0]);
+        fprintf(stderr, "       %s -d SYS5INI.BIN|APPENDxx.AAI [outdir]\n", argv[0]);
+        fprintf(stderr, "       %s -e [-f filter] SYS5INI.BIN|APPENDxx.AAI [outdir]\n", argv[0]);
+        fprintf(stderr, "       %s -p SYS5INI.BIN|APPENDxx.AAI indir APPENDyy\n", argv[0]);
+        fprintf(stderr, "       %s -t script.bin|indir [outfile|outdir]\n", argv[0]);
+        fprintf(stderr, "       %s -s script.bin|indir strings.csv|tabledir [outfile|outdir]\n", argv[0]);
+        fprintf(stderr, "       %s bench corpus [-n runs] [-j threads] [-o results.json]\n", argv[0]);
         return -1;
     }
 
-    std::filesystem::path input(argv[2]);
-    std::filesystem::path output;
-
     std::vector<std::string> args;
     for (int i = 0; i < argc; ++i) {
         args.push_back(*argv++);
     }
 
+    // --stats [path] prints where the time of -d / -a went, and optionally dumps it per file
+    bool print_stats = ALLOC_PROFILE; // profiling builds always report
+    std::filesystem::path stats_path;
+    for (size_t i = 2; i < args.size(); i++) {
+        if (args[i] != "--stats") continue;
+        print_stats = true;
+        if (i + 1 < args.size() && (args[i + 1].ends_with(".json") || args[i + 1].ends_with(".csv"))) {
+            stats_path = args[i + 1];
+            args.erase(args.begin() + i + 1);
+        }
+        args.erase(args.begin() + i);
+        break;
+    }
+    // --trace path writes a timeline of every worker, for chrome://tracing or Perfetto
+    std::filesystem::path trace_path;
+    for (size_t i = 2; i + 1 < args.size(); i++) {
+        if (args[i] != "--trace") continue;
+        trace_path = args[i + 1];
+        args.erase(args.begin() + i, args.begin() + i + 2);
+        break;
+    }
+    // --io picks how batches read and write their files : io_uring (or threads where it is missing), background threads,
+    // or memory mapped reads and plain writes on the workers. Directories default to io_uring, single files to sync.
+    std::string io_mode;
+    for (size_t i = 2; i + 1 < args.size(); i++) {
+        if (args[i] != "--io") continue;
+        io_mode = args[i + 1];
+        args.erase(args.begin() + i, args.begin() + i + 2);
+        break;
+    }
+    if (!io_mode.empty() && io_mode != "uring" && io_mode != "threads" && io_mode != "sync") {
+        fprintf(stderr, "Unknown --io mode %s, expected uring, threads or sync\n", io_mode.c_str());
+        return -1;
+    }
+    if (args.size() < 3) {
+        fprintf(stderr, "Missing input for %s\n", args[1].c_str());
+        return -1;
+    }
+
+    std::filesystem::path input(args[2]);
+    std::filesystem::path output;
+
     if (args[1] == "-x") {
-        // For debugging. Reads a file, disassembles it, reassembles, 
-        // and checks that the original and reassembled are binary identical
+        // For debugging. Reads every file, disassembles it, reassembles (or the reverse for .txt),
+        // and checks in memory that the original and the round-tripped copy are binary identical
         if (std::filesystem::is_directory(input)) {
-            for (auto& file : std::filesystem::directory_iterator(input)) {
-                if (file.path().extension() == ".bin" ||
-                    file.path().extension() == ".BIN" ||
-                    file.path().extension() == ".txt" ||
-                    file.path().extension() == ".TXT") {
-                    files.emplace_back(file, std::filesystem::path{});
-                }
-            }
+            files = collect_batch_files(input, {".bin", ".txt"});
+        } else {
+            files.push_back({input, {}, std::filesystem::file_size(input)});
+        }
 
-            // Use only 1 thread for this
-            for (const auto& file : files) {
-                doCheckFile();
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<Check_Result> results(files.size());
+        Thread_Pool pool(std::min(NUM_THREADS, std::max<size_t>(files.size(), 1)));
+        std::vector<Worker_Scratch> scratch(pool.size());
+        pool.run(files.size(), [&](size_t worker, size_t index) {
+            results[index] = CheckFile(files[index], scratch[worker]);
+            fprintf(stdout, "Checking file %s\t%s\n", files[index].input.string().c_str(), results[index].equal ? "equal" : "different!");
+        });
+
+        const auto end = std::chrono::steady_clock::now();
+
+        size_t different = 0;
+        for (size_t i = 0; i < files.size(); i++) {
+            if (results[i].equal) continue;
+            if (different++ == 0) {
+                fprintf(stdout, "\nMismatching files :\n");
             }
-        } else {
-            CheckFile(input);
+            fprintf(stdout, "%s : first difference at 0x%zX\n\t%s\n", files[i].input.string().c_str(),
+                    results[i].first_difference, results[i].location.c_str());
+        }
+
+        fprintf(stdout, "\nChecked %zu files in %.3fs, %zu different.\n", files.size(),
+                std::chrono::duration<double>(end - start).count(), different);
+        pool.print_utilization(stdout);
+
+        if (different > 0) {
+            return -1;
         }
 
     } else if (args[1] == "-d" || args[1] == "-a") {
         // Dissassemble / Assemble
         const bool isDissassemble = args[1] == "-d" ? true : false;
+        std::optional<Build_Cache> cache;
+
+        if (isDissassemble && std::filesystem::is_regular_file(input) && is_archive_index(input)) {
+            // SYS5INI.BIN / APPENDxx.AAI : the scripts are read straight out of the archives
+            return doDisassembleArchive(input, args.size() > 3 ? args[3] : "decompiled");
+        }
 
         if (std::filesystem::is_directory(input)) {
-            std::string inExt, upperExt, outExt;
             if (args.size() > 3) {
-                output = args[3] + "/";
+                output = args[3];
             } else if (isDissassemble) {
-                output = "decompiled/";
+                output = "decompiled";
             } else {
-                output = "compiled/";
+                output = "compiled";
             }
 
-            if (isDissassemble) {
-                inExt = ".bin";
-                upperExt = ".BIN";
-                outExt = ".txt";
-            } else {
-                inExt = ".txt";
-                upperExt = ".TXT";
-                outExt = ".BIN";
-            }
+            // Subdirectories are mirrored into the output, largest scripts first
+            files = isDissassemble ? collect_batch_files(input, output, ".bin", ".txt")
+                                   : collect_batch_files(input, output, ".txt", ".BIN");
 
-            if (!std::filesystem::is_directory(output)) {
-                std::filesystem::create_directories(output);
+            // Batch assembly only rebuilds the scripts which changed since the last run
+            if (!isDissassemble) {
+                cache.emplace(output / "age-asm.cache", op_code_table_version());
             }
-
-            for (auto& file : std::filesystem::directory_iterator(input)) {
-                if (file.file_size() > 0 && 
-                    file.path().extension() == inExt ||
-                    file.path().extension() == upperExt) {
-                    output.replace_filename(file.path().filename());
-                    output.replace_extension(outExt);
-                    files.emplace_back(file, output);
-                }
+            if (io_mode.empty()) {
+                io_mode = "uring";
             }
         } else {
             if (args.size() > 3) {
@@ -97,18 +189,51 @@ int main(s32 argc, char** argv) {
                 output.replace_extension(isDissassemble ? ".txt" : ".BIN");
             }
             //std::cout << "Single file, in: " << input.string() << " out: " << output.string() << "\n";
-            files.emplace_back(input, std::move(output));
+            files.push_back({input, std::move(output), std::filesystem::file_size(input)});
         }
 
         const auto start = std::chrono::system_clock::now();
 
-        std::vector<std::thread> threads;
-        for (u32 i = 0; i < std::min(NUM_THREADS, files.size()); i++) {
-            threads.emplace_back(isDissassemble ? doDisassemble : doAssemble);
+        // Every file has its own slot, so the workers never share one
+        std::vector<File_Stats> stats(print_stats ? files.size() : 0);
+        for (size_t i = 0; i < stats.size(); i++) {
+            stats[i].input = files[i].input;
         }
 
-        for (auto& thread : threads) {
-            thread.join();
+        // Phases reach the trace through the stats, which are then needed even without --stats
+        std::optional<Trace_Recorder> trace;
+        if (!trace_path.empty()) {
+            trace.emplace();
+        }
+
+        // Reads ahead of the workers and writes behind them
+        std::optional<Async_IO> io;
+        if (io_mode == "uring" || io_mode == "threads") {
+            io.emplace(files, Async_IO_Options{.allow_ring = io_mode == "uring"});
+        }
+
+        std::atomic<size_t> failed{0};
+        Thread_Pool pool(std::min(NUM_THREADS, std::max<size_t>(files.size(), 1)));
+        std::vector<Worker_Scratch> scratch(pool.size());
+        pool.run(files.size(), [&](size_t worker, size_t index) {
+            Script_Stats trace_stats;
+            Script_Stats* file_stats = print_stats ? &stats[index].stats : trace ? &trace_stats : nullptr;
+            if (trace) {
+                file_stats->listener = &*trace;
+            }
+            Trace_Span span(trace ? &*trace : nullptr, isDissassemble ? "disassemble" : "assemble", &files[index].input);
+            const bool done = isDissassemble ? doDisassemble(files[index], scratch[worker], file_stats, io ? &*io : nullptr)
+                                             : doAssemble(files[index], scratch[worker], cache ? &*cache : nullptr, file_stats, io ? &*io : nullptr);
+            if (!done) {
+                failed++;
+            }
+        });
+        // The cache may only be saved once the outputs it records are written
+        if (io) {
+            failed += io->finish();
+        }
+        if (cache) {
+            cache->save();
         }
 
         const auto end = std::chrono::system_clock::now();
@@ -119,117 +244,640 @@ int main(s32 argc, char** argv) {
             std::cout << "Assembly took ";
         std::cout << (float)std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000 <<
             "s on " << std::thread::hardware_concurrency() << " cores." << '\n';
+        pool.print_utilization(stdout);
+        if (io) {
+            const std::string_view backend = io->backend();
+            fprintf(stdout, "Files were read and written through %.*s.\n", (int)backend.size(), backend.data());
+        }
+
+        if (trace && !trace->write(trace_path)) {
+            fprintf(stderr, "Unable to write %s\n", trace_path.string().c_str());
+        }
+        if (print_stats) {
+            print_stats_table(stats, std::filesystem::is_directory(input) ? input : input.parent_path(), stdout);
+            if (!stats_path.empty() && !write_stats(stats, stats_path)) {
+                fprintf(stderr, "Unable to write %s\n", stats_path.string().c_str());
+            }
+        }
+
+        if (failed > 0) {
+            fprintf(stderr, "%zu of %zu files failed.\n", failed.load(), files.size());
+            return -1;
+        }
+
+    } else if (args[1] == "-e") {
+        // Extract archive entries, e.g. -f .bin for only the scripts. The filter is not case sensitive.
+        std::string filter;
+        std::vector<std::string> positional;
+        for (size_t i = 2; i < args.size(); i++) {
+            if ((args[i] == "-f" || args[i] == "--filter") && i + 1 < args.size()) {
+                filter = args[++i];
+            } else {
+                positional.push_back(args[i]);
+            }
+        }
+        if (positional.empty()) {
+            fprintf(stderr, "Missing archive index\n");
+            return -1;
+        }
+
+        return doExtract(positional[0], positional.size() > 1 ? positional[1] : "data", filter);
+
+    } else if (args[1] == "-p") {
+        // Repack the files of indir which differ from the archives into APPENDyy.ALF / APPENDyy.AAI
+        if (args.size() < 5) {
+            fprintf(stderr, "Usage: %s -p SYS5INI.BIN|APPENDxx.AAI indir APPENDyy\n", args[0].c_str());
+            return -1;
+        }
+
+        return doRepack(input, args[3], args[4]);
+
+    } else if (args[1] == "-t" || args[1] == "-s") {
+        // Extract the strings of compiled scripts into CSV string tables / put them back in, without going through text.
+        // Tables of a directory mirror its layout, and scripts without a table are left alone.
+        const bool isExtract = args[1] == "-t";
+        if (!isExtract && args.size() < 4) {
+            fprintf(stderr, "Usage: %s -s script.bin|indir strings.csv|tabledir [outfile|outdir]\n", args[0].c_str());
+            return -1;
+        }
+        const std::filesystem::path tables = isExtract ? std::filesystem::path{} : std::filesystem::path{args[3]};
+        const size_t output_arg = isExtract ? 3 : 4;
+
+        std::vector<std::filesystem::path> table_paths;
+        if (std::filesystem::is_directory(input)) {
+            output = args.size() > output_arg ? std::filesystem::path{args[output_arg]} : isExtract ? "strings" : "patched";
+            files = isExtract ? collect_batch_files(input, output, ".bin", ".csv") : collect_batch_files(input, output, ".bin", ".BIN");
+            if (!isExtract) {
+                for (const auto& file : files) {
+                    table_paths.push_back(tables / std::filesystem::relative(file.input, input).replace_extension(".csv"));
+                }
+            }
+        } else {
+            if (args.size() > output_arg) {
+                output = args[output_arg];
+            } else {
+                // Never patch over the original script unless asked to, the table may not be the right one
+                output = input;
+                output.replace_extension(isExtract ? ".csv" : ".patched" + input.extension().string());
+            }
+            files.push_back({input, std::move(output), std::filesystem::file_size(input)});
+            table_paths.push_back(tables);
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+
+        std::atomic<size_t> failed{0};
+        Thread_Pool pool(std::min(NUM_THREADS, std::max<size_t>(files.size(), 1)));
+        std::vector<Worker_Scratch> scratch(pool.size());
+        pool.run(files.size(), [&](size_t worker, size_t index) {
+            if (isExtract) {
+                if (!doExtractStrings(files[index], scratch[worker])) {
+                    failed++;
+                }
+            } else if (files.size() == 1 || std::filesystem::exists(table_paths[index])) {
+                if (!doPatchStrings(files[index], table_paths[index], scratch[worker])) {
+                    failed++;
+                }
+            }
+        });
+
+        const auto end = std::chrono::steady_clock::now();
+        fprintf(stdout, "%s of %zu scripts took %.3fs on %u cores.\n", isExtract ? "String extraction" : "String injection",
+                files.size(), std::chrono::duration<double>(end - start).count(), std::thread::hardware_concurrency());
+        pool.print_utilization(stdout);
+
+        return failed > 0 ? -1 : 0;
+
+    } else if (args[1] == "bench") {
+        // Times the whole pipelines over a corpus, e.g. to compare releases on the same game
+        Corpus_Bench_Options options;
+        options.corpus = input;
+        options.max_threads = NUM_THREADS;
+        for (size_t i = 3; i + 1 < args.size(); i += 2) {
+            size_t count = 0;
+            if ((args[i] == "-n" || args[i] == "-j") && (!parse_count(args[i + 1], count) || count > UINT32_MAX)) {
+                fprintf(stderr, "Usage: %s bench corpus [-n runs] [-j threads] [-o results.json]\n", args[0].c_str());
+                return -1;
+            }
+            if (args[i] == "-n") {
+                options.runs = static_cast<u32>(count);
+            } else if (args[i] == "-j") {
+                options.max_threads = count;
+            } else if (args[i] == "-o") {
+                options.json_output = args[i + 1];
+            } else {
+                fprintf(stderr, "Unknown bench option : %s\n", args[i].c_str());
+                return -1;
+            }
+        }
+
+        return run_corpus_bench(options);
 
     } else {
         fprintf(stderr, "Unknown option : %s\n", args[1].c_str());
         return -1;
     }
     return 0;
+} catch (const Age_Error& error) {
+    // Scripts report their errors through a Result, this is for the archive indexes
+    fprintf(stderr, "%s\n", error.what());
+    return -1;
 }
 
-void doDisassemble() {
-    static std::atomic<u32> front;
+// The contents of a batch file, either as the asynchronous I/O read them or memory mapped
+struct Batch_Input {
+    std::optional<std::vector<std::byte>> contents;
+    std::optional<Mapped_File> mapped;
+
+    Batch_Input(const Batch_File& file, Async_IO* io) {
+        if (io) {
+            contents = io->read(file);
+        } else {
+            mapped.emplace(file.input);
+        }
+    }
+
+    bool is_open() const {
+        return contents || (mapped && mapped->is_open());
+    }
+
+    std::span<const std::byte> data() const {
+        return contents ? std::span<const std::byte>{*contents} : mapped->data();
+    }
+};
 
-    while (front < files.size()) {
-        auto& [input, output] = files[front++];
+bool doDisassemble(const Batch_File& file, Worker_Scratch& scratch, Script_Stats* stats, Async_IO* io) {
+    const auto& [input, output, size] = file;
 
-        fprintf(stdout, "Disassembling %s into %s\n", input.string().c_str(), output.string().c_str());
+    fprintf(stdout, "Disassembling %s into %s\n", input.string().c_str(), output.string().c_str());
 
-        std::ifstream fd_in(input, std::ios::in | std::ios::binary);
-        if (!fd_in.is_open()) {
-            fprintf(stderr, "Unable to open %s, skipping.\n", input.string().c_str());
-            continue;
+    Phase_Timer read_timer(stats, Stats_Phase::Read);
+    const Batch_Input fd_in(file, io);
+    if (!fd_in.is_open()) {
+        fprintf(stderr, "Unable to open %s, skipping.\n", input.string().c_str());
+        return false;
+    }
+    read_timer.stop();
+
+    scratch.first.clear();
+    const Result result = disassemble(fd_in.data(), scratch.first, &scratch.arena, stats);
+    scratch.arena.reset();
+    if (!result) {
+        fprintf(stderr, "Unable to disassemble %s : %s\n", input.string().c_str(), result.error.c_str());
+        return false;
+    }
+
+    // Asynchronous writes report their failures through Async_IO::finish()
+    Phase_Timer write_timer(stats, Stats_Phase::Write);
+    if (io) {
+        io->write(output, scratch.first);
+        return true;
+    }
+    std::ofstream fd_out(output, std::ios::out | std::ios::binary);
+    fd_out.write(scratch.first.data(), scratch.first.size());
+    fd_out.close();
+    if (!fd_out) {
+        fprintf(stderr, "Unable to write %s\n", output.string().c_str());
+        return false;
+    }
+    return true;
+}
+
+bool doAssemble(const Batch_File& file, Worker_Scratch& scratch, Build_Cache* cache, Script_Stats* stats, Async_IO* io) {
+    const auto& [input, output, size] = file;
+
+    Phase_Timer read_timer(stats, Stats_Phase::Read);
+    const Batch_Input fd_in(file, io);
+    if (!fd_in.is_open()) {
+        fprintf(stderr, "Unable to open %s, skipping.\n", input.string().c_str());
+        return false;
+    }
+    const auto text{fd_in.data()};
+    read_timer.stop();
+
+    const u64 input_hash = cache ? content_hash(text) : 0;
+    u64 output_size{};
+    if (cache && cache->is_up_to_date(output, input_hash, output_size)) {
+        fprintf(stdout, "%s is up to date\n", output.string().c_str());
+        cache->update(output, input_hash, output_size);
+        return true;
+    }
+
+    fprintf(stdout, "Assembling %s into %s\n", input.string().c_str(), output.string().c_str());
+
+    scratch.first.clear();
+    const Result result = assemble(std::string_view{reinterpret_cast<const char*>(text.data()), text.size()}, scratch.first, &scratch.arena, stats);
+    scratch.arena.reset();
+    if (!result) {
+        fprintf(stderr, "Unable to assemble %s : %s\n", input.string().c_str(), result.error.c_str());
+        return false;
+    }
+
+    Phase_Timer write_timer(stats, Stats_Phase::Write);
+    if (io) {
+        // The cache only learns about the output once it is on disk
+        io->write(output, scratch.first, [cache, &output, input_hash, size = scratch.first.size()](bool written) {
+            if (cache && written) {
+                cache->update(output, input_hash, size);
+            }
+        });
+        return true;
+    }
+    std::ofstream fd_out(output, std::ios::out | std::ios::binary);
+    fd_out.write(scratch.first.data(), scratch.first.size());
+    fd_out.close();
+    write_timer.stop();
+    if (!fd_out) {
+        fprintf(stderr, "Unable to write %s\n", output.string().c_str());
+        return false;
+    }
+
+    if (cache) {
+        cache->update(output, input_hash, scratch.first.size());
+    }
+    return true;
+}
+
+Check_Result CheckFile(const Batch_File& file, Worker_Scratch& scratch) {
+    Check_Result result;
+
+    Mapped_File fd_in(file.input);
+    if (!fd_in.is_open()) {
+        result.equal = false;
+        result.location = "unable to open";
+        return result;
+    }
+
+    const auto original{fd_in.data()};
+    const bool is_binary = file.input.extension() == ".bin" || file.input.extension() == ".BIN";
+
+    auto& [first, second, arena] = scratch;
+    first.clear();
+    second.clear();
+    Result round_tripped;
+    if (is_binary) {
+        round_tripped = disassemble(original, first, &arena);
+        arena.reset();
+        if (round_tripped) {
+            round_tripped = assemble(first.view(), second, &arena);
+        }
+    } else {
+        round_tripped = assemble(std::string_view{reinterpret_cast<const char*>(original.data()), original.size()}, first, &arena);
+        arena.reset();
+        if (round_tripped) {
+            round_tripped = disassemble(std::as_bytes(std::span{first.data(), first.size()}), second, &arena);
         }
-        std::stringstream fd{disassemble(fd_in)};
-        std::ofstream fd_out(output, std::ios::out | std::ios::binary);
-        fd_out.write(fd.str().data(), fd.str().length());
     }
+    arena.reset();
+
+    if (!round_tripped) {
+        result.equal = false;
+        result.location = round_tripped.error;
+        return result;
+    }
+
+    const auto round_trip{std::as_bytes(std::span{second.data(), second.size()})};
+    const auto [mismatch, _] = std::ranges::mismatch(original, round_trip);
+    if (original.size() == round_trip.size() && mismatch == original.end()) {
+        return result;
+    }
+
+    result.equal = false;
+    result.first_difference = static_cast<size_t>(mismatch - original.begin());
+
+    if (is_binary) {
+        result.location = describe_offset(original, result.first_difference);
+    } else {
+        // Report the line of the script which differs
+        const std::string_view text{reinterpret_cast<const char*>(original.data()), original.size()};
+        const size_t line_start = text.substr(0, result.first_difference).rfind('\n');
+        const size_t begin = line_start == std::string_view::npos ? 0 : line_start + 1;
+        const size_t line_end = std::min(text.find_first_of("\r\n", begin), text.size());
+        const size_t line = std::count(text.begin(), text.begin() + begin, '\n') + 1;
+        result.location = "line " + std::to_string(line) + " : " + std::string{text.substr(begin, line_end - begin)};
+    }
+
+    return result;
 }
 
-void doAssemble() {
-    static std::atomic<u32> front;
+int doExtract(const std::filesystem::path& index_path, const std::filesystem::path& output, std::string_view filter) {
+    const auto start = std::chrono::steady_clock::now();
 
-    while (front < files.size()) {
-        auto& [input, output] = files[front++];
+    const Archive_Set archives(index_path);
+    const auto entries = archives.select(filter);
 
-        fprintf(stdout, "Assembling %s into %s\n", input.string().c_str(), output.string().c_str());
+    fprintf(stdout, "Extracting %s\n", archives.index().title.c_str());
 
-        std::ifstream fd_in(input, std::ios::in);
-        if (!fd_in.is_open()) {
-            fprintf(stderr, "Unable to open %s, skipping.\n", input.string().c_str());
+    // Directories first, so the workers only ever write files
+    std::vector<std::filesystem::path> paths(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        const auto relative = archives.relative_path(*entries[i]);
+        if (relative.empty()) {
+            fprintf(stderr, "Refusing to extract %s outside of %s\n", entries[i]->name.c_str(), output.string().c_str());
             continue;
         }
-        std::stringstream fd{assemble(fd_in)};
-        std::ofstream fd_out(output, std::ios::out | std::ios::binary);
-        fd_out.write(fd.str().data(), fd.str().length());
+        paths[i] = output / relative;
+        std::filesystem::create_directories(paths[i].parent_path());
     }
+
+    std::atomic<size_t> failed{0};
+    Thread_Pool pool(std::min(NUM_THREADS, std::max<size_t>(entries.size(), 1)));
+    pool.run(entries.size(), [&](size_t, size_t index) {
+        if (paths[index].empty()) {
+            failed++;
+            return;
+        }
+
+        const auto contents = archives.data(*entries[index]);
+        if (contents.size() != entries[index]->length) {
+            fprintf(stderr, "Unable to read %s, skipping.\n", entries[index]->name.c_str());
+            failed++;
+            return;
+        }
+
+        fprintf(stdout, "\t%s\n", paths[index].string().c_str());
+        std::ofstream fd_out(paths[index], std::ios::out | std::ios::binary);
+        fd_out.write(reinterpret_cast<const char*>(contents.data()), contents.size());
+        if (!fd_out) {
+            fprintf(stderr, "Unable to write %s.\n", paths[index].string().c_str());
+            failed++;
+        }
+    });
+
+    const auto end = std::chrono::steady_clock::now();
+    fprintf(stdout, "Extracted %zu of %zu entries in %.3fs.\n", entries.size() - failed, entries.size(),
+            std::chrono::duration<double>(end - start).count());
+    pool.print_utilization(stdout);
+
+    return failed > 0 ? -1 : 0;
 }
 
-bool compareFile(std::istream& f1, std::istream& f2) {
-    // Read 128Kb at a time
-    static std::array<char, 131'072> buf1, buf2;
-    do {
-        f1.read(buf1.data(), buf1.size());
-        f2.read(buf2.data(), buf2.size());
-        size_t r1 = f1.gcount();
-        size_t r2 = f2.gcount();
-        if (r1 != r2 || std::memcmp(buf1.data(), buf2.data(), r1)) {
-            return false;
+int doDisassembleArchive(const std::filesystem::path& index_path, const std::filesystem::path& output) {
+    const auto start = std::chrono::steady_clock::now();
+
+    const Archive_Set archives(index_path);
+    std::vector<const Archive_Entry*> entries = archives.select(".bin");
+    // Only actual scripts, not names which merely contain .bin
+    std::erase_if(entries, [](const Archive_Entry* entry) {
+        const std::string_view name{entry->name};
+        return name.size() < 4 || (name.substr(name.size() - 4) != ".bin" && name.substr(name.size() - 4) != ".BIN");
+    });
+
+    // Outputs mirror the extraction layout, with .txt scripts
+    std::vector<std::filesystem::path> paths(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        const auto relative = archives.relative_path(*entries[i]);
+        if (relative.empty()) {
+            fprintf(stderr, "Refusing to write %s outside of %s\n", entries[i]->name.c_str(), output.string().c_str());
+            continue;
+        }
+        paths[i] = output / relative;
+        paths[i].replace_extension(".txt");
+        std::filesystem::create_directories(paths[i].parent_path());
+    }
+
+    std::atomic<size_t> failed{0};
+    Thread_Pool pool(std::min(NUM_THREADS, std::max<size_t>(entries.size(), 1)));
+    std::vector<Worker_Scratch> scratch(pool.size());
+    pool.run(entries.size(), [&](size_t worker, size_t index) {
+        const auto contents = archives.data(*entries[index]);
+        if (paths[index].empty() || contents.size() != entries[index]->length) {
+            fprintf(stderr, "Unable to read %s, skipping.\n", entries[index]->name.c_str());
+            failed++;
+            return;
+        }
+
+        fprintf(stdout, "Disassembling %s into %s\n", entries[index]->name.c_str(), paths[index].string().c_str());
+
+        auto& [text, unused, arena] = scratch[worker];
+        text.clear();
+        const Result result = disassemble(contents, text, &arena);
+        arena.reset();
+        if (!result) {
+            fprintf(stderr, "Unable to disassemble %s : %s\n", entries[index]->name.c_str(), result.error.c_str());
+            failed++;
+            return;
+        }
+        std::ofstream fd_out(paths[index], std::ios::out | std::ios::binary);
+        fd_out.write(text.data(), text.size());
+        fd_out.close();
+        if (!fd_out) {
+            fprintf(stderr, "Unable to write %s\n", paths[index].string().c_str());
+            failed++;
         }
-    } while (!f1.eof() && !f2.eof());
+    });
 
-    return f1.eof() && f2.eof();
+    const auto end = std::chrono::steady_clock::now();
+    fprintf(stdout, "Disassembly of %zu scripts took %.3fs on %u cores.\n", entries.size() - failed,
+            std::chrono::duration<double>(end - start).count(), std::thread::hardware_concurrency());
+    pool.print_utilization(stdout);
+
+    return failed > 0 ? -1 : 0;
 }
 
-void CheckFile(const std::filesystem::path& input) {
-    std::ifstream fd_in;
-    std::stringstream file1, file2;
+int doRepack(const std::filesystem::path& index_path, const std::filesystem::path& input_dir, const std::filesystem::path& output) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto lower = [](std::string text) {
+        std::ranges::transform(text, text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return text;
+    };
+
+    const Archive_Set archives(index_path);
+
+    // Files are matched either in the -e layout (<archive>/<name>) or by their name alone
+    std::unordered_map<std::string, const Archive_Entry*> by_path, by_name;
+    for (const auto& entry : archives.index().entries) {
+        const auto relative = archives.relative_path(entry);
+        if (relative.empty()) continue;
+        by_path[lower(relative.generic_string())] = &entry;
+        by_name[lower(relative.lexically_relative(*relative.begin()).generic_string())] = &entry;
+    }
 
-    if (input.extension() == ".bin" || input.extension() == ".BIN") {
-        fd_in = std::ifstream(input, std::ios::in | std::ios::binary);
-        if (!fd_in.is_open()) {
-            fprintf(stderr, "Unable to open %s.\n", input.string().c_str());
-            exit(-1);
+    const std::vector<Batch_File> inputs = collect_batch_files(input_dir, {});
+    std::vector<const Archive_Entry*> matches(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        const std::string key = lower(std::filesystem::relative(inputs[i].input, input_dir).generic_string());
+        if (const auto it = by_path.find(key); it != by_path.end()) {
+            matches[i] = it->second;
+        } else if (const auto it = by_name.find(key); it != by_name.end()) {
+            matches[i] = it->second;
+        } else {
+            fprintf(stdout, "%s is not in %s, skipping.\n", inputs[i].input.string().c_str(), index_path.string().c_str());
         }
-        file1 = disassemble(fd_in);
-        file1.clear();
-        file1.seekg(0, std::ios::beg);
-        file2 = assemble(file1);
-    } else {
-        fd_in = std::ifstream(input, std::ios::in);
+    }
+
+    Thread_Pool pool(std::min(NUM_THREADS, std::max<size_t>(inputs.size(), 1)));
+
+    // Only files whose contents differ from the archived copy go into the append archive
+    std::vector<char> changed(inputs.size());
+    pool.run(inputs.size(), [&](size_t, size_t index) {
+        if (!matches[index]) return;
+
+        Mapped_File fd_in(inputs[index].input);
         if (!fd_in.is_open()) {
-            fprintf(stderr, "Unable to open %s.\n", input.string().c_str());
-            exit(-1);
+            fprintf(stderr, "Unable to open %s, skipping.\n", inputs[index].input.string().c_str());
+            return;
         }
-        file1 = assemble(fd_in);
-        file1.clear();
-        file1.seekg(0, std::ios::beg);
-        file2 = disassemble(file1);
+        const auto original = archives.data(*matches[index]);
+        const auto current = fd_in.data();
+        changed[index] = original.size() != current.size() || std::memcmp(original.data(), current.data(), current.size()) != 0;
+    });
+
+    // Lay the payloads out back to back, largest first, and keep the index in the original order
+    std::vector<size_t> selected;
+    Archive_Index index;
+    index.title = archives.index().title;
+    index.append = true;
+    index.archives.push_back(output.filename().string() + ".ALF");
+
+    u64 archive_size = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (!changed[i]) continue;
+        if (archive_size + inputs[i].size > 0xFFFFFFFF) {
+            fprintf(stderr, "Too much data for a single archive, stopping at %s.\n", inputs[i].input.string().c_str());
+            return -1;
+        }
+        selected.push_back(i);
+        index.entries.push_back({matches[i]->name, 0, matches[i]->file_index, static_cast<u32>(archive_size), static_cast<u32>(inputs[i].size)});
+        archive_size += inputs[i].size;
+    }
+    std::ranges::sort(index.entries, {}, [&](const Archive_Entry& entry) { return entry.file_index; });
+
+    std::filesystem::path alf_path = output;
+    alf_path += ".ALF";
+    std::filesystem::path aai_path = output;
+    aai_path += ".AAI";
+    if (output.has_parent_path()) {
+        std::filesystem::create_directories(output.parent_path());
     }
 
-    fd_in.clear();
-    fd_in.seekg(0, std::ios::beg);
-    file2.clear();
-    file2.seekg(0, std::ios::beg);
+    // Size the archive once, then every worker writes its payloads in place through its own stream
+    std::ofstream(alf_path, std::ios::out | std::ios::binary | std::ios::trunc).close();
+    std::filesystem::resize_file(alf_path, archive_size);
 
-    bool equal = compareFile(fd_in, file2);
+    std::atomic<size_t> failed{0};
+    std::vector<u32> offsets(selected.size());
+    for (size_t i = 0, offset = 0; i < selected.size(); i++) {
+        offsets[i] = static_cast<u32>(offset);
+        offset += inputs[selected[i]].size;
+    }
+    std::vector<std::fstream> streams(pool.size());
+    pool.run(selected.size(), [&](size_t worker, size_t index) {
+        const Batch_File& file = inputs[selected[index]];
+        fprintf(stdout, "\t%s\n", file.input.string().c_str());
+
+        Mapped_File fd_in(file.input);
+        auto& stream = streams[worker];
+        if (!stream.is_open()) {
+            stream.open(alf_path, std::ios::in | std::ios::out | std::ios::binary);
+        }
+        const auto contents = fd_in.data();
+        if (!fd_in.is_open() || contents.size() != file.size ||
+            !stream.seekp(offsets[index]).write(reinterpret_cast<const char*>(contents.data()), contents.size())) {
+            fprintf(stderr, "Unable to copy %s into %s.\n", file.input.string().c_str(), alf_path.string().c_str());
+            failed++;
+        }
+    });
+    for (auto& stream : streams) {
+        stream.close();
+    }
 
-    if (!equal) {
-        fprintf(stdout, "\tdifferent!\n");
-        exit(-1);
-    } else {
-        fprintf(stdout, "\tequal\n");
+    std::vector<std::byte> aai;
+    write_archive_index(index, aai);
+    std::ofstream fd_out(aai_path, std::ios::out | std::ios::binary);
+    fd_out.write(reinterpret_cast<const char*>(aai.data()), aai.size());
+
+    const auto end = std::chrono::steady_clock::now();
+    fprintf(stdout, "Repacked %zu changed files (0x%llx bytes) into %s in %.3fs.\n", selected.size(), static_cast<unsigned long long>(archive_size),
+            aai_path.string().c_str(), std::chrono::duration<double>(end - start).count());
+    pool.print_utilization(stdout);
+
+    return failed > 0 || !fd_out ? -1 : 0;
+}
+
+bool doExtractStrings(const Batch_File& file, Worker_Scratch& scratch) {
+    const auto& [input, output, size] = file;
+
+    fprintf(stdout, "Extracting strings from %s into %s\n", input.string().c_str(), output.string().c_str());
+
+    Mapped_File fd_in(input);
+    if (!fd_in.is_open()) {
+        fprintf(stderr, "Unable to open %s, skipping.\n", input.string().c_str());
+        return false;
+    }
+    std::vector<String_Entry> strings;
+    const Result result = extract_strings(fd_in.data(), strings, &scratch.arena);
+    scratch.arena.reset();
+    if (!result) {
+        fprintf(stderr, "Unable to extract strings from %s : %s\n", input.string().c_str(), result.error.c_str());
+        return false;
     }
+
+    scratch.first.clear();
+    write_string_table(strings, scratch.first);
+    std::ofstream fd_out(output, std::ios::out | std::ios::binary);
+    fd_out.write(scratch.first.data(), scratch.first.size());
+    fd_out.close();
+    if (!fd_out) {
+        fprintf(stderr, "Unable to write %s\n", output.string().c_str());
+        return false;
+    }
+    return true;
 }
 
-void doCheckFile() {
-    static std::atomic<u32> front;
+bool doPatchStrings(const Batch_File& file, const std::filesystem::path& table, Worker_Scratch& scratch) {
+    const auto& [input, output, size] = file;
+
+    std::vector<String_Entry> strings;
+    {
+        Mapped_File fd_table(table);
+        if (!fd_table.is_open()) {
+            fprintf(stderr, "Unable to open %s\n", table.string().c_str());
+            return false;
+        }
+        const auto csv{fd_table.data()};
+        const Result result = read_string_table(std::string_view{reinterpret_cast<const char*>(csv.data()), csv.size()}, strings);
+        if (!result) {
+            fprintf(stderr, "Unable to read %s : %s\n", table.string().c_str(), result.error.c_str());
+            return false;
+        }
+    }
+
+    size_t replaced;
+    std::vector<const String_Entry*> unmatched;
+    scratch.first.clear();
+    {
+        Mapped_File fd_in(input);
+        if (!fd_in.is_open()) {
+            fprintf(stderr, "Unable to open %s\n", input.string().c_str());
+            return false;
+        }
+        const Result result = patch_strings(fd_in.data(), strings, scratch.first, replaced, unmatched, &scratch.arena);
+        scratch.arena.reset();
+        if (!result) {
+            fprintf(stderr, "Unable to patch %s : %s\n", input.string().c_str(), result.error.c_str());
+            return false;
+        }
+    }
 
-    while (front < files.size()) {
-        auto& [input, output] = files[front++];
+    for (const String_Entry* entry : unmatched) {
+        fprintf(stderr, "No string argument at %08x:%x in %s, ignoring it.\n", entry->offset, entry->argument, input.string().c_str());
+    }
 
-        fprintf(stdout, "Checking file %s\n", input.string().c_str());
+    // The input is unmapped by now, so it can be patched in place when outfile names it
+    std::ofstream fd_out(output, std::ios::out | std::ios::binary);
+    if (!fd_out.write(scratch.first.data(), scratch.first.size())) {
+        fprintf(stderr, "Unable to write %s\n", output.string().c_str());
+        return false;
+    }
 
-        CheckFile(input);
+    // Rows which neither replaced a string nor went unmatched repeat an id, the last of them won
+    const size_t repeated = strings.size() - replaced - unmatched.size();
+    if (repeated > 0) {
+        fprintf(stderr, "%zu rows of %s repeat an earlier id, only the last of each was used.\n", repeated, table.string().c_str());
     }
-}
\ No newline at end of file
+
+    // Unmatched and repeated rows are warnings : the script itself was patched fine
+    fprintf(stdout, "Replaced %zu of %zu strings in %s\n", replaced, strings.size(), output.string().c_str());
+    return true;
+}
@@ -0,0 +1,349 @@
+#include "libage.h"
+#include "script-generator.h"
+#include "script-lexer.h"
+#include "string-pool.h"
+#include "transcode.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Results are added here so the optimizer can't drop the work being measured
+static volatile u64 sink;
+
+struct Bench_Settings {
+    double min_time{0.5}; // seconds per benchmark
+    std::string filter;
+    double max_allocations{-1}; // per instruction, for disassemble / assemble in AGE_ALLOC_PROFILE builds
+};
+
+// Set once a run allocates more than the threshold allows
+static bool allocations_regressed = false;
+
+// Runs body at least 5 times and for at least min_time, then reports the median run as throughput.
+// items is how many instructions / strings / lookups one run handles, bytes how much input it reads.
+template <typename Body>
+static void run_benchmark(const Bench_Settings& settings, std::string_view name, u64 items, std::string_view unit, u64 bytes, Body&& body) {
+    if (!settings.filter.empty() && name.find(settings.filter) == std::string_view::npos) {
+        return;
+    }
+
+    body(); // warms up the caches and grows the buffers
+
+    std::vector<double> samples;
+    double total = 0;
+    while (samples.size() < 5 || total < settings.min_time) {
+        const auto start = std::chrono::steady_clock::now();
+        body();
+        const auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double>(end - start).count());
+        total += samples.back();
+    }
+    std::ranges::sort(samples);
+    const double median = samples[samples.size() / 2];
+
+    fprintf(stdout, "%-34.*s %10.3f ms %10.2f M%.*s/s", (int)name.size(), name.data(), median * 1e3, items / median / 1e6, (int)unit.size(), unit.data());
+    if (bytes > 0) {
+        fprintf(stdout, " %10.2f MB/s", bytes / median / 1e6);
+    }
+    fprintf(stdout, "\n");
+}
+
+static void fail_on(const Result& result, const char* what) {
+    if (!result) {
+        fprintf(stderr, "%s failed : %s\n", what, result.error.c_str());
+        exit(-1);
+    }
+}
+
+// Reports the heap use of one run, as counted by AGE_ALLOC_PROFILE builds, and checks it against the threshold.
+// The run before it warms up the arena, so only the allocations every file pays for are counted.
+template <typename Body>
+static void check_allocations(const Bench_Settings& settings, std::string_view name, u64 instructions, Body&& body) {
+    if constexpr (!ALLOC_PROFILE) {
+        return;
+    }
+    if (!settings.filter.empty() && name.find(settings.filter) == std::string_view::npos) {
+        return;
+    }
+
+    Script_Stats warm_up;
+    body(&warm_up);
+    Script_Stats stats;
+    body(&stats);
+
+    Alloc_Stats total;
+    for (const auto& phase : stats.allocations) {
+        total.add(phase);
+    }
+    const double per_instruction = static_cast<double>(total.count) / std::max<u64>(instructions, 1);
+    const bool regressed = settings.max_allocations >= 0 && per_instruction > settings.max_allocations;
+    allocations_regressed |= regressed;
+
+    fprintf(stdout, "%-34.*s %10llu allocs %10.3f /instr %10.1f kB peak%s\n", (int)name.size(), name.data(), static_cast<unsigned long long>(total.count),
+            per_instruction, total.peak / 1e3, regressed ? "  over the threshold!" : "");
+}
+
+static std::span<const std::byte> as_bytes(const Output_Buffer& buffer) {
+    return std::as_bytes(std::span{buffer.data(), buffer.size()});
+}
+
+// Everything measured on one generated script
+struct Bench_Script {
+    std::string name;
+    Output_Buffer text;
+    Output_Buffer binary;
+};
+
+static void bench_script(const Bench_Settings& settings, Bench_Script& input) {
+    const std::string_view text{input.text.view()};
+    const auto binary{as_bytes(input.binary)};
+    const std::string prefix = input.name + ' ';
+
+    Header header(binary);
+    Script script;
+    parse_script(binary, header, script, Parse_Mode::Full);
+    const u64 instructions = script.instructions.size();
+
+    Scratch_Arena arena;
+    Output_Buffer output;
+
+    run_benchmark(settings, prefix + "parse_script full", instructions, "instr", binary.size(), [&] {
+        {
+            Script parsed{&arena};
+            parse_script(binary, header, parsed, Parse_Mode::Full);
+            sink = sink + parsed.arguments.size();
+        }
+        arena.reset();
+    });
+
+    run_benchmark(settings, prefix + "parse_script layout", instructions, "instr", binary.size(), [&] {
+        {
+            Script parsed{&arena};
+            parse_script(binary, header, parsed, Parse_Mode::Layout);
+            sink = sink + parsed.arguments.size();
+        }
+        arena.reset();
+    });
+
+    run_benchmark(settings, prefix + "disassemble_instruction", instructions, "instr", 0, [&] {
+        output.clear();
+        for (const auto& instruction : script.instructions) {
+            disassemble_instruction(header, script, instruction, output);
+        }
+        sink = sink + output.size();
+    });
+
+    run_benchmark(settings, prefix + "script lexer", instructions, "instr", text.size(), [&] {
+        Script_Lexer lexer(text);
+        u64 tokens = 0;
+        for (Token token = lexer.next(); token.type != Token_Type::End; token = lexer.next()) {
+            tokens++;
+        }
+        sink = sink + tokens;
+    });
+
+    run_benchmark(settings, prefix + "disassemble", instructions, "instr", binary.size(), [&] {
+        output.clear();
+        fail_on(disassemble(binary, output, &arena), "disassemble");
+        arena.reset();
+    });
+
+    run_benchmark(settings, prefix + "assemble", instructions, "instr", text.size(), [&] {
+        output.clear();
+        fail_on(assemble(text, output, &arena), "assemble");
+        arena.reset();
+    });
+
+    check_allocations(settings, prefix + "disassemble heap", instructions, [&](Script_Stats* stats) {
+        output.clear();
+        fail_on(disassemble(binary, output, &arena, stats), "disassemble");
+        arena.reset();
+    });
+
+    check_allocations(settings, prefix + "assemble heap", instructions, [&](Script_Stats* stats) {
+        output.clear();
+        fail_on(assemble(text, output, &arena, stats), "assemble");
+        arena.reset();
+    });
+
+    // The pool kernels, on the strings in their file encoding
+    Script layout;
+    parse_script(binary, header, layout, Parse_Mode::Layout);
+    std::vector<size_t> string_offsets;
+    for (const auto& argument : layout.arguments) {
+        if (argument.type == 2) {
+            string_offsets.push_back(header.GetLength() + (static_cast<size_t>(argument.raw_data) << 2));
+        }
+    }
+
+    std::vector<std::string> narrow(string_offsets.size());
+    std::vector<std::u16string> wide(string_offsets.size());
+    u64 string_bytes = 0;
+    for (size_t i = 0; i < string_offsets.size(); i++) {
+        header.IsVer5() ? decode_pool_string(binary, string_offsets[i], wide[i]) : decode_pool_string(binary, string_offsets[i], narrow[i]);
+        string_bytes += narrow[i].size() + wide[i].size() * sizeof(char16_t);
+    }
+
+    run_benchmark(settings, prefix + "decode_pool_string", string_offsets.size(), "str", string_bytes, [&] {
+        std::string decoded;
+        std::u16string decoded_wide;
+        for (const size_t offset : string_offsets) {
+            decoded.clear();
+            decoded_wide.clear();
+            header.IsVer5() ? decode_pool_string(binary, offset, decoded_wide) : decode_pool_string(binary, offset, decoded);
+        }
+        sink = sink + decoded.size() + decoded_wide.size();
+    });
+
+    run_benchmark(settings, prefix + "encode_pool_string", string_offsets.size(), "str", string_bytes, [&] {
+        std::string pool;
+        for (size_t i = 0; i < string_offsets.size(); i++) {
+            header.IsVer5() ? encode_pool_string(wide[i], pool) : encode_pool_string(narrow[i], pool);
+        }
+        sink = sink + pool.size();
+    });
+
+    // Code page conversions, on the UTF8 strings of the script
+    std::vector<std::string_view> utf8;
+    u64 utf8_bytes = 0;
+    for (u32 i = 0; i < script.string_offsets.size(); i++) {
+        utf8.push_back(script.string(i));
+        utf8_bytes += utf8.back().size();
+    }
+
+    if (header.IsVer5()) {
+        run_benchmark(settings, prefix + "utf8_to_utf16", utf8.size(), "str", utf8_bytes, [&] {
+            std::u16string converted;
+            for (const auto string : utf8) {
+                converted.clear();
+                utf8_to_utf16(string, converted);
+            }
+            sink = sink + converted.size();
+        });
+
+        run_benchmark(settings, prefix + "utf16_to_utf8", wide.size(), "str", string_bytes, [&] {
+            std::string converted;
+            for (const auto& string : wide) {
+                converted.clear();
+                utf16_to_utf8(string, converted);
+            }
+            sink = sink + converted.size();
+        });
+    } else {
+        run_benchmark(settings, prefix + "utf8_to_cp932", utf8.size(), "str", utf8_bytes, [&] {
+            std::string converted;
+            for (const auto string : utf8) {
+                converted.clear();
+                utf8_to_cp932(string, converted);
+            }
+            sink = sink + converted.size();
+        });
+
+        run_benchmark(settings, prefix + "cp932_to_utf8", narrow.size(), "str", string_bytes, [&] {
+            std::string converted;
+            for (const auto& string : narrow) {
+                converted.clear();
+                cp932_to_utf8(string, converted);
+            }
+            sink = sink + converted.size();
+        });
+    }
+}
+
+static void bench_lookups(const Bench_Settings& settings, const Bench_Script& input) {
+    const auto binary{as_bytes(input.binary)};
+    Header header(binary);
+    Script script;
+    parse_script(binary, header, script, Parse_Mode::Layout);
+
+    // The op codes and mnemonics in script order, so the lookups see a realistic mix
+    std::vector<u32> op_codes;
+    std::vector<std::string_view> labels;
+    for (const auto& instruction : script.instructions) {
+        op_codes.push_back(instruction.definition->op_code);
+        labels.push_back(instruction.definition->label);
+    }
+
+    run_benchmark(settings, "instruction_for_op_code", op_codes.size(), "op", 0, [&] {
+        u64 arguments = 0;
+        for (const u32 op_code : op_codes) {
+            arguments += instruction_for_op_code(op_code, 0)->argument_count;
+        }
+        sink = sink + arguments;
+    });
+
+    run_benchmark(settings, "instruction_for_label", labels.size(), "op", 0, [&] {
+        u64 arguments = 0;
+        for (const auto label : labels) {
+            arguments += instruction_for_label(label)->argument_count;
+        }
+        sink = sink + arguments;
+    });
+}
+
+int main(s32 argc, char** argv) {
+    Bench_Settings settings;
+    Generator_Options options;
+    std::filesystem::path write_to;
+
+    for (s32 i = 1; i < argc; i++) {
+        const std::string_view arg{argv[i]};
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return -1;
+        }
+        if (arg == "-n") {
+            options.instruction_count = static_cast<u32>(std::stoul(argv[++i]));
+        } else if (arg == "-s") {
+            options.seed = std::stoull(argv[++i]);
+        } else if (arg == "-t") {
+            settings.min_time = std::stod(argv[++i]);
+        } else if (arg == "-f") {
+            settings.filter = argv[++i];
+        } else if (arg == "-w") {
+            write_to = argv[++i];
+        } else if (arg == "-a") {
+            settings.max_allocations = std::stod(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [-n instructions] [-s seed] [-t seconds] [-f filter] [-w outdir] [-a allocations]\n", argv[0]);
+            fprintf(stderr, "       -w writes the generated scripts to outdir instead of benchmarking them\n");
+            fprintf(stderr, "       -a fails when disassemble or assemble make more heap allocations per instruction (AGE_ALLOC_PROFILE builds)\n");
+            return -1;
+        }
+    }
+
+    std::array<Bench_Script, 2> scripts;
+    scripts[0].name = "sys4";
+    scripts[1].name = "sys5";
+    for (auto& script : scripts) {
+        options.version_5 = &script == &scripts[1];
+        generate_script(options, script.text);
+        fail_on(assemble(script.text.view(), script.binary), "assemble");
+    }
+
+    if (!write_to.empty()) {
+        std::filesystem::create_directories(write_to);
+        for (const auto& script : scripts) {
+            std::ofstream(write_to / (script.name + ".txt"), std::ios::binary).write(script.text.data(), script.text.size());
+            std::ofstream(write_to / (script.name + ".BIN"), std::ios::binary).write(script.binary.data(), script.binary.size());
+        }
+        return 0;
+    }
+
+    // Failing here keeps a guard on a build which can't count from passing without checking anything
+    if (!ALLOC_PROFILE && settings.max_allocations >= 0) {
+        fprintf(stderr, "-a needs a build with AGE_ALLOC_PROFILE defined, allocations are not counted.\n");
+        return -1;
+    }
+
+    fprintf(stdout, "%u instructions per script, seed %llu\n\n", options.instruction_count, static_cast<unsigned long long>(options.seed));
+    bench_lookups(settings, scripts[0]);
+    for (auto& script : scripts) {
+        fprintf(stdout, "\n");
+        bench_script(settings, script);
+    }
+    return allocations_regressed ? 1 : 0;
+}
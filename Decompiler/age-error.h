@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdarg>
+#include <cstdio>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+// The library never exits : malformed data throws an Age_Error from wherever it is found,
+// and the entry points (disassemble, assemble, the string tables) catch it and hand back a Result.
+class Age_Error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// printf-style, throws an Age_Error with the formatted message
+[[noreturn]] inline void fail(const char* format, ...) {
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    throw Age_Error(message);
+}
+
+// What the library entry points return : empty on success, otherwise what went wrong and where
+struct Result {
+    std::string error;
+
+    bool ok() const {
+        return error.empty();
+    }
+
+    explicit operator bool() const {
+        return ok();
+    }
+};
+
+// Runs body, turning whatever it throws into a Result
+template <typename Body>
+Result capture_errors(Body&& body) {
+    try {
+        body();
+        return {};
+    } catch (const Age_Error& error) {
+        return {error.what()};
+    } catch (const std::bad_alloc&) {
+        return {"Out of memory"};
+    }
+}
@@ -1,9 +1,7 @@
-#include "Windows.h"
 #include "age-shared.h"
-#include <map>
 #include <iostream>
 
-// Keep this array ordered by op_code for binary search
+// Keep this array ordered by op_code, the build fails otherwise
 static consteval auto make_defs() {
     return std::to_array<Instruction_Definition>({
         {0x1, "u004149C0", 0x0}, // error
@@ -558,81 +556,157 @@ static consteval auto make_defs() {
 }
 static constexpr auto definitions = make_defs();
 
-const Instruction_Definition* instruction_for_op_code(u32 op_code, std::streamoff offset) {
-    size_t low = 0;
-    size_t high = definitions.size() - 1;
-
-    while (low <= high) {
-        const size_t mid = (low + high) >> 1;
-        const size_t mid_op_code = definitions[mid].op_code;
-
-        //std::cout << "op 0x" << std::hex << op_code << " --- mid 0x" << std::hex << mid << "\n";
-
-        if (mid_op_code < op_code) {
-            low = mid + 1;
-        } else if (mid_op_code > op_code) {
-            high = mid - 1;
-        } else {
-            //std::cout << "Found instruction 0x" << std::hex << mid_op_code << "\n";
-            return &definitions[mid];
+static consteval bool definitions_are_sorted() {
+    for (size_t i = 1; i < definitions.size(); i++) {
+        if (definitions[i - 1].op_code >= definitions[i].op_code) {
+            return false;
         }
     }
+    return true;
+}
+static_assert(definitions_are_sorted(), "definitions must be sorted by op_code, without duplicates");
+static_assert(definitions.back().op_code < OP_CODE_LIMIT, "op_code out of range of the lookup table, raise OP_CODE_LIMIT");
 
-    fprintf(stderr, "Unknown instruction : 0x%x at 0x%llx\n", op_code, offset);
-    exit(-1);
-    return nullptr;
+static consteval auto make_op_code_table() {
+    std::array<Op_Code_Info, OP_CODE_LIMIT> table{};
+    for (const auto& definition : definitions) {
+        table[definition.op_code] = {
+            &definition,
+            static_cast<u32>(compute_length(definition)),
+            is_control_flow(&definition),
+            is_array(&definition),
+        };
+    }
+    return table;
 }
+static constexpr auto op_code_table = make_op_code_table();
 
-static std::map<const std::string_view, const Instruction_Definition*> str_memo;
+const Op_Code_Info& op_code_info(u32 op_code) {
+    static constexpr Op_Code_Info unknown{};
+    return op_code < OP_CODE_LIMIT ? op_code_table[op_code] : unknown;
+}
 
-const Instruction_Definition* instruction_for_label(const std::string_view label) {
-    const auto it = str_memo.find(label);
-    if (it != str_memo.end()) {
-        return it->second;
+const Instruction_Definition* instruction_for_op_code(u32 op_code, std::streamoff offset) {
+    const Instruction_Definition* definition = op_code_info(op_code).definition;
+    if (definition) {
+        return definition;
     }
 
-    // We'll have to actually scan through here
-    const auto instr = std::ranges::find_if(definitions,
-                                 [&label](const Instruction_Definition& instr) { return instr.label == label; });
+    fail("Unknown instruction : 0x%x at 0x%llx", op_code, static_cast<long long>(offset));
+}
+
+// Perfect hash over every mnemonic, built at compile time with "hash and displace" : the label hash picks a bucket,
+// and each bucket stores the displacement that sends all of its labels to otherwise unused slots.
+// The table is immutable, so lookups from the assembler threads need no locking.
+static constexpr size_t LABEL_BUCKETS = 256;
+static constexpr size_t LABEL_SLOTS = 1024;
+static constexpr size_t LABEL_BUCKET_CAPACITY = 32;
+static constexpr u16 EMPTY_SLOT = 0xFFFF;
+static_assert(definitions.size() < EMPTY_SLOT && definitions.size() < LABEL_SLOTS);
 
-    if (instr != definitions.end()) {
-        str_memo[instr->label] = &*instr;
-        return &*instr;
+static constexpr u64 label_hash(std::string_view label) {
+    // FNV-1a
+    u64 hash = 0xCBF29CE484222325ull;
+    for (const char c : label) {
+        hash ^= static_cast<u8>(c);
+        hash *= 0x100000001B3ull;
     }
+    return hash;
+}
 
-    fprintf(stderr, "Unknown instruction : %s\n", label.data());
-    exit(-1);
-    return nullptr;
+static constexpr size_t label_bucket(u64 hash) {
+    return (hash >> 40) & (LABEL_BUCKETS - 1);
 }
 
-std::wstring cp_to_utf16(u32 code_page, const std::string& input) {
-    const auto in_size = MultiByteToWideChar(code_page, 0, input.data(), static_cast<int>(input.size()), nullptr, 0);
+static constexpr size_t label_slot(u64 hash, u32 displacement) {
+    u64 x = hash ^ (displacement * 0x9E3779B97F4A7C15ull);
+    x ^= x >> 32;
+    x *= 0xD6E8FEB86659FD93ull;
+    x ^= x >> 32;
+    return x & (LABEL_SLOTS - 1);
+}
+
+struct Label_Table {
+    std::array<u32, LABEL_BUCKETS> displacements{};
+    std::array<u16, LABEL_SLOTS> slots{};
+};
+
+static consteval Label_Table make_label_table() {
+    Label_Table table{};
+    table.slots.fill(EMPTY_SLOT);
 
-    if (in_size == 0) {
-        return L"";
+    std::array<std::array<u16, LABEL_BUCKET_CAPACITY>, LABEL_BUCKETS> buckets{};
+    std::array<size_t, LABEL_BUCKETS> bucket_sizes{};
+    for (size_t i = 0; i < definitions.size(); i++) {
+        const size_t bucket = label_bucket(label_hash(definitions[i].label));
+        if (bucket_sizes[bucket] == LABEL_BUCKET_CAPACITY) {
+            throw "Label bucket overflow, raise LABEL_BUCKETS";
+        }
+        buckets[bucket][bucket_sizes[bucket]++] = static_cast<u16>(i);
     }
 
-    std::wstring utf16(in_size, L'\0');
+    // Place the fullest buckets first, while most slots are still free
+    for (size_t size = LABEL_BUCKET_CAPACITY; size > 0; size--) {
+        for (size_t bucket = 0; bucket < LABEL_BUCKETS; bucket++) {
+            if (bucket_sizes[bucket] != size) {
+                continue;
+            }
+
+            for (u32 displacement = 0;; displacement++) {
+                // Only reachable with duplicate labels, which can never hash apart
+                if (displacement == 4096) {
+                    throw "Could not place a label bucket, are there duplicate labels?";
+                }
+
+                std::array<size_t, LABEL_BUCKET_CAPACITY> placed{};
+                bool fits = true;
+                for (size_t k = 0; k < size && fits; k++) {
+                    placed[k] = label_slot(label_hash(definitions[buckets[bucket][k]].label), displacement);
+                    fits = table.slots[placed[k]] == EMPTY_SLOT;
+                    for (size_t j = 0; j < k && fits; j++) {
+                        fits = placed[j] != placed[k];
+                    }
+                }
 
-    if (in_size != MultiByteToWideChar(code_page, 0, input.data(), static_cast<int>(input.size()), utf16.data(), static_cast<int>(utf16.size()))) {
-        utf16.clear();
+                if (fits) {
+                    for (size_t k = 0; k < size; k++) {
+                        table.slots[placed[k]] = buckets[bucket][k];
+                    }
+                    table.displacements[bucket] = displacement;
+                    break;
+                }
+            }
+        }
     }
 
-    return utf16;
+    return table;
 }
+static constexpr auto label_table = make_label_table();
 
-std::string utf16_to_cp(u32 code_page, const std::wstring& input) {
-    const auto in_size = WideCharToMultiByte(code_page, 0, input.data(), static_cast<int>(input.size()), nullptr, 0, nullptr, nullptr);
+const Instruction_Definition* instruction_for_label(const std::string_view label) {
+    const u64 hash = label_hash(label);
+    const u16 index = label_table.slots[label_slot(hash, label_table.displacements[label_bucket(hash)])];
 
-    if (in_size == 0) {
-        return "";
+    if (index != EMPTY_SLOT && definitions[index].label == label) {
+        return &definitions[index];
     }
 
-    std::string output(in_size, '\0');
+    fail("Unknown instruction : %.*s", (int)label.size(), label.data());
+}
 
-    if (in_size != WideCharToMultiByte(code_page, 0, input.data(), static_cast<int>(input.size()), output.data(), static_cast<int>(output.size()), nullptr, nullptr)) {
-        output.clear();
+// Fingerprint of every definition, so build outputs made with a different table can be told apart
+static consteval u64 make_op_code_table_version() {
+    u64 version = label_hash("");
+    for (const auto& definition : definitions) {
+        for (const u64 value : {u64{definition.op_code}, u64{definition.argument_count}, label_hash(definition.label)}) {
+            version ^= value;
+            version *= 0x100000001B3ull;
+        }
     }
+    return version;
+}
 
-    return output;
+u64 op_code_table_version() {
+    static constexpr u64 version = make_op_code_table_version();
+    return version;
 }
@@ -5,15 +5,16 @@
 #include <filesystem>
 #include <fstream>
 #include <span>
+#include <memory_resource>
 #include <array>
+#include <vector>
+#include <cstring>
+#include <algorithm>
 
+#include "age-error.h"
 #include "types.h"
 
-#define CP_UTF8 65001
-#define CP_UTF16 1200
-#define CP_932 932
-std::wstring cp_to_utf16(u32 code_page, const std::string& input);
-std::string utf16_to_cp(u32 code_page, const std::wstring& input);
+#include "transcode.h"
 
 struct BinaryHeader {
     char signature[8];
@@ -39,29 +40,21 @@ struct BinaryHeader {
 static_assert(sizeof(BinaryHeader) == 0x3C);
 
 struct Header {
-    Header(std::istream& fd) {
-        std::array<char, 4> sig{};
-        fd.read(sig.data(), sig.size());
+    Header(std::span<const std::byte> data) {
+        static constexpr std::u16string_view sys5{u"SYS5501 "};
 
-        if (!std::memcmp(sig.data(), "SYS4", sig.size())) {
-            fd.seekg(0, 0);
-            fd.read((char*)&m_header, sizeof(BinaryHeader));
+        if (data.size() >= 0x3C && !std::memcmp(data.data(), "SYS4", 4)) {
+            std::memcpy(&m_header, data.data(), sizeof(BinaryHeader));
             m_length = 0x3C;
             m_is_ver5 = false;
+        } else if (data.size() >= 0x44 && !std::memcmp(data.data(), sys5.data(), 4)) {
+            // The signature is plain ASCII, narrow it for the text header
+            std::ranges::copy(sys5, m_header.signature);
+            std::memcpy(&m_header.local_integer_1, data.data() + 16, sizeof(BinaryHeader) - sizeof(m_header.signature));
+            m_length = 0x44;
+            m_is_ver5 = true;
         } else {
-            std::wstring sys5{L"SYS5501 "};
-            if (!std::memcmp(sig.data(), sys5.data(), sig.size())) {
-                fd.seekg(0, 0);
-                auto utf8_sig{utf16_to_cp(CP_UTF8, sys5)};
-                std::memcpy(&m_header.signature, utf8_sig.data(), sizeof(m_header.signature));
-                fd.seekg(16, 0);
-                fd.read((char*)&m_header.local_integer_1, sizeof(BinaryHeader) - sizeof(m_header.signature));
-                m_length = 0x44;
-                m_is_ver5 = true;
-            } else {
-                fprintf(stderr, "Could not determine header version!\n");
-                exit(-1);
-            }
+            fail("Could not determine header version!");
         }
     }
 
@@ -75,8 +68,7 @@ struct Header {
             m_length = 0x3C;
         }
         else {
-            fprintf(stderr, "Could not determine header version!\n");
-            exit(-1);
+            fail("Could not determine header version!");
         }
     }
 
@@ -98,34 +90,22 @@ private:
     BinaryHeader m_header;
 };
 
-struct Data_Array {
-    u32 length;
-    std::vector<u32> data;
-
-    friend std::istream& operator>>(std::istream& is, Data_Array& da) {
-        is.read((char*)&da.length, sizeof(da.length));
-        da.data.reserve(da.length);
-        for (u32 i{ 0 }; i < da.data.capacity(); ++i) {
-            u32 val;
-            is.read((char*)&val, sizeof(val));
-            da.data.push_back(val);
-        }
-        return is;
-    };
-};
+// Reads a little-endian value straight out of a script image, bailing out if the file is truncated.
+template <typename T>
+inline T read_value(std::span<const std::byte> data, size_t offset) {
+    if (offset > data.size() || data.size() - offset < sizeof(T)) {
+        fail("Unexpected end of file at 0x%zx", offset);
+    }
+    T value;
+    std::memcpy(&value, data.data() + offset, sizeof(T));
+    return value;
+}
 
+// A single argument, exactly as it is encoded : two u32s.
+// Strings and arrays don't live here, raw_data holds their index in the script's side tables until the file offsets are known.
 struct Argument {
     u32 type{};
     u32 raw_data{};
-    std::string decoded_stringv4{};
-    std::wstring decoded_stringv5{};
-    Data_Array data_array{};
-
-    friend std::istream& operator>>(std::istream& is, const Argument& arg) {
-        is.read((char*)&arg.type, sizeof(arg.type));
-        is.read((char*)&arg.raw_data, sizeof(arg.raw_data));
-        return is;
-    };
 };
 
 struct Instruction_Definition {
@@ -136,27 +116,77 @@ struct Instruction_Definition {
 
 struct Instruction {
     const Instruction_Definition* definition;
-    std::vector<Argument> arguments;
-    std::streamoff offset;
+    u32 first_argument; // index of the first argument in Script::arguments, there are definition->argument_count of them
+    u32 offset;         // in words, past the header
+};
+
+// Compact form of a whole script : every argument of every instruction sits in one flat array,
+// and strings and arrays are kept in side tables which the arguments index.
+// Everything is allocated from one memory resource, usually a worker's scratch arena.
+struct Script {
+    explicit Script(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        instructions(resource),
+        arguments(resource),
+        string_data(resource),
+        string_offsets(resource),
+        array_data(resource),
+        array_offsets(resource) {
+    }
 
-    Instruction(const Instruction_Definition* def, std::vector<Argument> args, std::streamoff off) :
-        definition(def),
-        arguments(std::move(args)),
-        offset(off) {
+    std::pmr::vector<Instruction> instructions;
+    std::pmr::vector<Argument> arguments;
+
+    // Strings back to back, in the order they are referenced. Disassembled scripts hold the UTF8 text,
+    // assembled ones the encoded string pool itself.
+    std::pmr::string string_data;
+    std::pmr::vector<u32> string_offsets;
+    // Arrays back to back, each as its length followed by its elements (the footer layout)
+    std::pmr::vector<u32> array_data;
+    std::pmr::vector<u32> array_offsets;
+
+    std::pmr::memory_resource* resource() const {
+        return arguments.get_allocator().resource();
     }
-    Instruction(const Instruction_Definition* def, std::streamoff off) :
-        definition(def),
-        offset(off) {
-        arguments.reserve(4);
+
+    void clear() {
+        instructions.clear();
+        arguments.clear();
+        string_data.clear();
+        string_offsets.clear();
+        array_data.clear();
+        array_offsets.clear();
     }
-    
-    Argument* GetArgument(size_t idx) {
-        return &arguments.at(idx);
+
+    std::span<Argument> arguments_of(const Instruction& instruction) {
+        return {arguments.data() + instruction.first_argument, instruction.definition->argument_count};
+    }
+    std::span<const Argument> arguments_of(const Instruction& instruction) const {
+        return {arguments.data() + instruction.first_argument, instruction.definition->argument_count};
     }
-};
 
-const Instruction_Definition* instruction_for_op_code(u32 op_code, std::streamoff offset);
-const Instruction_Definition* instruction_for_label(const std::string_view label);
+    std::string_view string(u32 index) const {
+        const size_t end = index + 1 < string_offsets.size() ? string_offsets[index + 1] : string_data.size();
+        return std::string_view{string_data}.substr(string_offsets[index], end - string_offsets[index]);
+    }
+
+    std::span<const u32> array(u32 index) const {
+        return {array_data.data() + array_offsets[index] + 1, array_data[array_offsets[index]]};
+    }
+
+    // Copies the array at offset in image into the side table and returns its index
+    u32 read_array(std::span<const std::byte> image, size_t offset) {
+        const u32 length = read_value<u32>(image, offset);
+        offset += sizeof(u32);
+        if ((image.size() - offset) / sizeof(u32) < length) {
+            fail("Array at 0x%zx runs past the end of the file", offset);
+        }
+        array_offsets.push_back(static_cast<u32>(array_data.size()));
+        array_data.push_back(length);
+        array_data.resize(array_data.size() + length);
+        std::memcpy(array_data.data() + array_data.size() - length, image.data() + offset, length * sizeof(u32));
+        return static_cast<u32>(array_offsets.size() - 1);
+    }
+};
 
 inline constexpr bool is_control_flow(const Instruction_Definition* instruction) {
     return instruction->op_code == 0x8C ||
@@ -171,20 +201,42 @@ inline constexpr bool is_control_flow(const Instruction_Definition* instruction)
         instruction->op_code == 0x7B;
 }
 
-inline constexpr bool is_control_flow(const Instruction& instruction) {
-    return is_control_flow(instruction.definition);
-}
-
 inline constexpr bool is_array(const Instruction_Definition* instruction) {
     return instruction->op_code == 0x64;
 }
 
-inline constexpr bool is_label_argument(const Instruction& instruction, s32 x) {
-    return ((instruction.definition->op_code == 0x8C || instruction.definition->op_code == 0x8F) && instruction.arguments[x].raw_data != 0xFFFFFFFF) ||
-        (instruction.definition->op_code == 0xA0 && x > 0 && instruction.arguments[x].raw_data != 0xFFFFFFFF) ||
-        ((instruction.definition->op_code == 0xCC || instruction.definition->op_code == 0xFB) && x > 0 && instruction.arguments[x].raw_data != 0xFFFFFFFF) ||
-        (instruction.definition->op_code == 0xD4 && x >= 2 && instruction.arguments[x].raw_data != 0xFFFFFFFF) ||
-        (instruction.definition->op_code == 0x90 && x >= 4 && instruction.arguments[x].raw_data != 0xFFFFFFFF) ||
-        (instruction.definition->op_code == 0x7B && instruction.arguments[x].raw_data != 0xFFFFFFFF);
+inline constexpr size_t compute_length(const Instruction_Definition& definition) {
+    // op_code (4 bytes) + 2 * (4 bytes) * (argument_count)
+    return 4 + (static_cast<size_t>(definition.argument_count) << 3);
+}
+
+// Every op code sits below this, so they can index a flat table directly
+inline constexpr u32 OP_CODE_LIMIT = 0x400;
+
+// Facts about an op code, precomputed at compile time from the definitions
+struct Op_Code_Info {
+    const Instruction_Definition* definition{}; // nullptr when the op code is unknown
+    u32 length{};                               // encoded size in bytes
+    bool control_flow{};
+    bool array{};
+};
+
+const Op_Code_Info& op_code_info(u32 op_code);
+const Instruction_Definition* instruction_for_op_code(u32 op_code, std::streamoff offset);
+const Instruction_Definition* instruction_for_label(const std::string_view label);
+// Changes whenever an op code, mnemonic or argument count does
+u64 op_code_table_version();
+
+inline bool is_control_flow(const Instruction& instruction) {
+    return op_code_info(instruction.definition->op_code).control_flow;
+}
+
+inline constexpr bool is_label_argument(const Instruction_Definition* definition, s32 x, const Argument& argument) {
+    return ((definition->op_code == 0x8C || definition->op_code == 0x8F) && argument.raw_data != 0xFFFFFFFF) ||
+        (definition->op_code == 0xA0 && x > 0 && argument.raw_data != 0xFFFFFFFF) ||
+        ((definition->op_code == 0xCC || definition->op_code == 0xFB) && x > 0 && argument.raw_data != 0xFFFFFFFF) ||
+        (definition->op_code == 0xD4 && x >= 2 && argument.raw_data != 0xFFFFFFFF) ||
+        (definition->op_code == 0x90 && x >= 4 && argument.raw_data != 0xFFFFFFFF) ||
+        (definition->op_code == 0x7B && argument.raw_data != 0xFFFFFFFF);
 }
 
@@ -0,0 +1,78 @@
+#include "alloc-profile.h"
+
+#ifdef AGE_ALLOC_PROFILE
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Every block is prefixed with its size, so frees can be counted without sized deallocation
+static constexpr size_t BLOCK_HEADER = alignof(std::max_align_t);
+
+static void* counted_allocate(size_t size) {
+    auto* block = static_cast<std::byte*>(std::malloc(size + BLOCK_HEADER));
+    if (!block) {
+        return nullptr;
+    }
+    *reinterpret_cast<size_t*>(block) = size;
+
+    alloc_live += static_cast<s64>(size);
+    if (Alloc_Stats* stats = alloc_scope.stats) {
+        stats->count++;
+        stats->bytes += size;
+        stats->peak = std::max(stats->peak, static_cast<u64>(std::max<s64>(alloc_live - alloc_scope.base, 0)));
+    }
+    return block + BLOCK_HEADER;
+}
+
+static void counted_free(void* pointer) {
+    if (!pointer) {
+        return;
+    }
+    auto* block = static_cast<std::byte*>(pointer) - BLOCK_HEADER;
+    alloc_live -= static_cast<s64>(*reinterpret_cast<size_t*>(block));
+    std::free(block);
+}
+
+void* operator new(size_t size) {
+    if (void* pointer = counted_allocate(size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return counted_allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return counted_allocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    counted_free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    counted_free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    counted_free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    counted_free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    counted_free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    counted_free(pointer);
+}
+#endif
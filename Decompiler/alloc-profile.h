@@ -0,0 +1,33 @@
+#pragma once
+#include <algorithm>
+
+#include "types.h"
+
+// Heap use of one phase. Only AGE_ALLOC_PROFILE builds count anything : they replace the global operator new / delete
+// (alloc-hooks.cpp) with ones which charge every allocation of a thread to its current Alloc_Scope.
+#ifdef AGE_ALLOC_PROFILE
+inline constexpr bool ALLOC_PROFILE = true;
+#else
+inline constexpr bool ALLOC_PROFILE = false;
+#endif
+
+struct Alloc_Stats {
+    u64 count{};
+    u64 bytes{};
+    u64 peak{}; // the most the heap of the thread grew past its size when the phase began
+
+    void add(const Alloc_Stats& other) {
+        count += other.count;
+        bytes += other.bytes;
+        peak = std::max(peak, other.peak);
+    }
+};
+
+struct Alloc_Scope {
+    Alloc_Stats* stats{};
+    s64 base{}; // alloc_live when the scope was entered
+};
+
+// Bytes this thread allocated minus the ones it freed, and what they are charged to
+inline thread_local s64 alloc_live = 0;
+inline thread_local Alloc_Scope alloc_scope{};
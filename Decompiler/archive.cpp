@@ -0,0 +1,253 @@
+#include "age-error.h"
+#include "archive.h"
+#include "lzss.h"
+#include "transcode.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+
+static u32 read_u32(std::span<const std::byte> data, size_t offset) {
+    if (offset > data.size() || data.size() - offset < sizeof(u32)) {
+        fail("Archive index is truncated at 0x%zx", offset);
+    }
+    u32 value;
+    std::memcpy(&value, data.data() + offset, sizeof(value));
+    return value;
+}
+
+// Reads a NUL terminated UTF16 string of at most max_bytes, trimmed of surrounding whitespace
+static std::string read_utf16(std::span<const std::byte> data, size_t offset, size_t max_bytes) {
+    if (offset > data.size()) {
+        fail("Archive index is truncated at 0x%zx", offset);
+    }
+    max_bytes = std::min(max_bytes, data.size() - offset) & ~size_t{1};
+
+    std::u16string name;
+    for (size_t i = 0; i < max_bytes; i += 2) {
+        char16_t c;
+        std::memcpy(&c, data.data() + offset + i, sizeof(c));
+        if (c == 0) break;
+        name.push_back(c);
+    }
+
+    std::string utf8;
+    utf16_to_utf8(name, utf8);
+    const size_t first = utf8.find_first_not_of(" \t\r\n");
+    const size_t last = utf8.find_last_not_of(" \t\r\n");
+    return first == std::string::npos ? std::string{} : utf8.substr(first, last - first + 1);
+}
+
+static void read_uncompressed_index(std::span<const std::byte> data, Archive_Index& index) {
+    size_t pos = 0x200;
+
+    // Uncompressed indexes only come with trial versions, which have a single archive : its name, then its entries.
+    // Anything that doesn't fit that layout is refused rather than guessed at.
+    index.archives.push_back(read_utf16(data, pos, 0x200));
+    pos += 0x200;
+
+    const u32 entry_count = read_u32(data, pos);
+    pos += sizeof(u32);
+    if ((data.size() - pos) / 0x90 < entry_count) {
+        fail("Uncompressed archive index lists 0x%x entries but only has room for 0x%zx", entry_count, (data.size() - pos) / 0x90);
+    }
+
+    index.entries.reserve(entry_count);
+    for (u32 i = 0; i < entry_count; i++, pos += 0x90) {
+        index.entries.push_back({read_utf16(data, pos, 0x88), 0, i, read_u32(data, pos + 0x88), read_u32(data, pos + 0x8C)});
+    }
+
+    // Room for another name and entry count after the table means more than one archive
+    if (data.size() - pos >= 0x200 + sizeof(u32)) {
+        fail("Uncompressed archive index has 0x%zx bytes past its entries, only single archive indexes are supported", data.size() - pos);
+    }
+}
+
+static void read_compressed_index(std::span<const std::byte> data, Archive_Index& index) {
+    const size_t pos = index.append ? 0x214 : 0x21C;
+
+    const u32 uncompressed_size = read_u32(data, pos);
+    const u32 compressed_size = read_u32(data, pos + 8);
+    if (data.size() - (pos + 0xC) < compressed_size) {
+        fail("Archive index is truncated : 0x%x compressed bytes expected", compressed_size);
+    }
+
+    std::vector<std::byte> table;
+    if (lzss_decompress(data.subspan(pos + 0xC, compressed_size), uncompressed_size, table) != uncompressed_size) {
+        fail("Archive index is corrupted : decompressed 0x%zx bytes out of 0x%x", table.size(), uncompressed_size);
+    }
+    const std::span<const std::byte> view{table};
+
+    size_t offset = 0;
+    const u32 archive_count = read_u32(view, offset);
+    offset += sizeof(u32);
+    for (u32 i = 0; i < archive_count; i++, offset += 0x200) {
+        index.archives.push_back(read_utf16(view, offset, 0x200));
+    }
+
+    const u32 entry_count = read_u32(view, offset);
+    offset += sizeof(u32);
+    if ((view.size() - offset) / 0x90 < entry_count) {
+        fail("Archive index is corrupted : 0x%x entries don't fit", entry_count);
+    }
+
+    index.entries.reserve(entry_count);
+    for (u32 i = 0; i < entry_count; i++, offset += 0x90) {
+        Archive_Entry& entry = index.entries.emplace_back();
+        entry.name = read_utf16(view, offset, 0x80);
+        entry.archive_index = read_u32(view, offset + 0x80);
+        entry.file_index = read_u32(view, offset + 0x84);
+        entry.offset = read_u32(view, offset + 0x88);
+        entry.length = read_u32(view, offset + 0x8C);
+
+        if (entry.archive_index >= archive_count) {
+            fail("Archive index is corrupted : %s refers to archive %u of %u", entry.name.c_str(), entry.archive_index, archive_count);
+        }
+    }
+}
+
+bool is_archive_index(const std::filesystem::path& path) {
+    std::array<std::byte, 8> magic{};
+    std::ifstream fd(path, std::ios::in | std::ios::binary);
+    if (!fd.read(reinterpret_cast<char*>(magic.data()), magic.size())) {
+        return false;
+    }
+
+    const std::string text = read_utf16(magic, 0, magic.size());
+    return text.size() == 4 && (text.compare(0, 3, "S5I") == 0 || text.compare(0, 3, "S5A") == 0);
+}
+
+Archive_Index read_archive_index(std::span<const std::byte> data) {
+    Archive_Index index;
+
+    const std::string magic = read_utf16(data, 0, 8);
+    if (magic.size() != 4 || (magic.compare(0, 3, "S5I") != 0 && magic.compare(0, 3, "S5A") != 0)) {
+        fail("Bad archive index header, expected S5IN, S5IC or S5AC but got %s", magic.c_str());
+    }
+
+    index.title = read_utf16(data, 0x10, 0x100);
+    index.append = magic[2] == 'A';
+
+    if (magic[3] == 'C') {
+        read_compressed_index(data, index);
+    } else {
+        read_uncompressed_index(data, index);
+    }
+
+    return index;
+}
+
+static void put_u32(std::vector<std::byte>& output, u32 value) {
+    const size_t at = output.size();
+    output.resize(at + sizeof(value));
+    std::memcpy(output.data() + at, &value, sizeof(value));
+}
+
+// Writes text as UTF16 into a zero padded record of record_bytes, keeping room for the terminator
+static void put_utf16(std::vector<std::byte>& output, std::string_view text, size_t record_bytes) {
+    std::u16string utf16;
+    utf8_to_utf16(text, utf16);
+    if ((utf16.size() + 1) * sizeof(char16_t) > record_bytes) {
+        fail("Name too long for the archive index : %.*s", (int)text.size(), text.data());
+    }
+
+    const size_t at = output.size();
+    output.resize(at + record_bytes);
+    std::memcpy(output.data() + at, utf16.data(), utf16.size() * sizeof(char16_t));
+}
+
+void write_archive_index(const Archive_Index& index, std::vector<std::byte>& output) {
+    std::vector<std::byte> table;
+    table.reserve(8 + index.archives.size() * 0x200 + index.entries.size() * 0x90);
+
+    put_u32(table, static_cast<u32>(index.archives.size()));
+    for (const auto& archive : index.archives) {
+        put_utf16(table, archive, 0x200);
+    }
+
+    put_u32(table, static_cast<u32>(index.entries.size()));
+    for (const auto& entry : index.entries) {
+        put_utf16(table, entry.name, 0x80);
+        put_u32(table, entry.archive_index);
+        put_u32(table, entry.file_index);
+        put_u32(table, entry.offset);
+        put_u32(table, entry.length);
+    }
+
+    std::vector<std::byte> compressed;
+    lzss_compress(table, compressed);
+
+    put_utf16(output, index.append ? "S5AC" : "S5IC", 0x10);
+    put_utf16(output, index.title, 0x100);
+    output.resize(index.append ? 0x214 : 0x21C);
+    put_u32(output, static_cast<u32>(table.size()));
+    put_u32(output, static_cast<u32>(table.size()));
+    put_u32(output, static_cast<u32>(compressed.size()));
+    output.insert(output.end(), compressed.begin(), compressed.end());
+}
+
+Archive_Set::Archive_Set(const std::filesystem::path& index_path) {
+    Mapped_File index_file(index_path);
+    if (!index_file.is_open()) {
+        fail("Unable to open %s.", index_path.string().c_str());
+    }
+    m_index = read_archive_index(index_file.data());
+
+    // The archives sit next to their index
+    for (const auto& name : m_index.archives) {
+        const auto path = index_path.parent_path() / std::filesystem::path{std::u8string{name.begin(), name.end()}};
+        auto& archive = m_archives.emplace_back(std::make_unique<Mapped_File>(path));
+        if (!archive->is_open()) {
+            fprintf(stderr, "Unable to open archive %s, skipping its entries.\n", path.string().c_str());
+        }
+    }
+}
+
+std::vector<const Archive_Entry*> Archive_Set::select(std::string_view filter) const {
+    const auto lower = [](unsigned char c) { return static_cast<char>(std::tolower(c)); };
+
+    std::string needle{filter};
+    std::ranges::transform(needle, needle.begin(), lower);
+
+    std::vector<const Archive_Entry*> selected;
+    std::string name;
+    for (const auto& entry : m_index.entries) {
+        name = entry.name;
+        std::ranges::transform(name, name.begin(), lower);
+        if (name.find(needle) != std::string::npos) {
+            selected.push_back(&entry);
+        }
+    }
+
+    std::ranges::stable_sort(selected, [](const Archive_Entry* lhs, const Archive_Entry* rhs) { return lhs->length > rhs->length; });
+    return selected;
+}
+
+std::span<const std::byte> Archive_Set::data(const Archive_Entry& entry) const {
+    const auto& archive = m_archives[entry.archive_index];
+    if (!archive->is_open()) {
+        return {};
+    }
+
+    const auto contents = archive->data();
+    if (entry.offset > contents.size() || contents.size() - entry.offset < entry.length) {
+        return {};
+    }
+    return contents.subspan(entry.offset, entry.length);
+}
+
+std::filesystem::path Archive_Set::relative_path(const Archive_Entry& entry) const {
+    const auto& archive = m_index.archives[entry.archive_index];
+
+    // Names may use either separator
+    std::string name = entry.name;
+    std::ranges::replace(name, '\\', '/');
+    const std::filesystem::path path{std::u8string{name.begin(), name.end()}};
+
+    if (name.empty() || path.has_root_path() || std::ranges::any_of(path, [](const auto& part) { return part == ".."; })) {
+        return {};
+    }
+    return std::filesystem::path{std::u8string{archive.begin(), archive.end()}}.stem() / path;
+}
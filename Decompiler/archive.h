@@ -0,0 +1,63 @@
+#pragma once
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped-file.h"
+#include "types.h"
+
+// Game data lives in .ALF archives described by an index : SYS5INI.BIN for the base game, APPENDxx.AAI for patches.
+// The index header holds a UTF16 magic (S5IN uncompressed, S5IC compressed, S5AC compressed append) and the game title.
+// Compressed indexes hold an LZSS blob : the archive names in 0x200 byte records, then 0x90 byte entries
+// (UTF16 name, then archive index, file index, offset and length at +0x80).
+
+struct Archive_Entry {
+    std::string name; // UTF8
+    u32 archive_index;
+    u32 file_index;
+    u32 offset;
+    u32 length;
+};
+
+struct Archive_Index {
+    std::string title;                 // UTF8
+    bool append{};                     // APPENDxx.AAI rather than SYS5INI.BIN
+    std::vector<std::string> archives; // .ALF names, relative to the index
+    std::vector<Archive_Entry> entries;
+};
+
+// Whether the file starts with an index magic, which tells SYS5INI.BIN apart from a script
+bool is_archive_index(const std::filesystem::path& path);
+
+// Parses a whole index file. Throws an Age_Error on corrupted data.
+Archive_Index read_archive_index(std::span<const std::byte> data);
+
+// Writes a compressed index into output (replacing its contents) : S5AC for an append index, S5IC otherwise.
+void write_archive_index(const Archive_Index& index, std::vector<std::byte>& output);
+
+// An index along with every .ALF it refers to, memory mapped. Throws an Age_Error if the index is missing or corrupted.
+class Archive_Set {
+public:
+    explicit Archive_Set(const std::filesystem::path& index_path);
+
+    const Archive_Index& index() const {
+        return m_index;
+    }
+
+    // Entries whose name contains filter, not case sensitive (all of them for an empty filter), largest first
+    std::vector<const Archive_Entry*> select(std::string_view filter) const;
+
+    // Contents of an entry, empty if its archive is missing or the entry runs past its end
+    std::span<const std::byte> data(const Archive_Entry& entry) const;
+
+    // Where an entry is extracted to, relative to the output folder : <archive name without extension>/<entry name>.
+    // Empty for names which would escape that folder.
+    std::filesystem::path relative_path(const Archive_Entry& entry) const;
+
+private:
+    Archive_Index m_index;
+    std::vector<std::unique_ptr<Mapped_File>> m_archives;
+};
@@ -0,0 +1,452 @@
+#include "async-io.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#endif
+
+static std::optional<std::vector<std::byte>> read_whole_file(const std::filesystem::path& path) {
+    std::ifstream fd_in(path, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!fd_in) {
+        return std::nullopt;
+    }
+    std::vector<std::byte> data(static_cast<size_t>(fd_in.tellg()));
+    fd_in.seekg(0);
+    if (!fd_in.read(reinterpret_cast<char*>(data.data()), data.size())) {
+        return std::nullopt;
+    }
+    return data;
+}
+
+static bool write_whole_file(const std::filesystem::path& path, const Output_Buffer& data) {
+    std::ofstream fd_out(path, std::ios::out | std::ios::binary);
+    fd_out.write(data.data(), data.size());
+    fd_out.close();
+    return !fd_out.fail();
+}
+
+#ifdef __linux__
+// Just enough of io_uring for whole file reads and writes, straight on the system calls
+struct Io_Ring {
+    ~Io_Ring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+        if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_size);
+        if (fd >= 0) close(fd);
+    }
+
+    bool open(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        // IORING_OP_READ / WRITE came with 5.6, as did this feature flag
+        if (fd < 0 || !(params.features & IORING_FEAT_RW_CUR_POS)) {
+            return false;
+        }
+
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        }
+
+        sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED) return false;
+        cq_ring = single_mmap ? sq_ring : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) return false;
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) return false;
+
+        const auto at = [](void* ring, u32 offset) { return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset); };
+        sq_head = at(sq_ring, params.sq_off.head);
+        sq_tail = at(sq_ring, params.sq_off.tail);
+        sq_mask = *at(sq_ring, params.sq_off.ring_mask);
+        sq_array = at(sq_ring, params.sq_off.array);
+        sq_entries = params.sq_entries;
+        cq_head = at(cq_ring, params.cq_off.head);
+        cq_tail = at(cq_ring, params.cq_off.tail);
+        cq_mask = *at(cq_ring, params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(static_cast<char*>(cq_ring) + params.cq_off.cqes);
+        return true;
+    }
+
+    // Copies sqe into the submission queue, it is handed to the kernel by the next submit_and_wait()
+    bool queue(const io_uring_sqe& sqe) {
+        const unsigned tail = *sq_tail;
+        if (tail - std::atomic_ref<unsigned>(*sq_head).load(std::memory_order_acquire) >= sq_entries) {
+            return false;
+        }
+        const unsigned index = tail & sq_mask;
+        sqes[index] = sqe;
+        sq_array[index] = index;
+        std::atomic_ref<unsigned>(*sq_tail).store(tail + 1, std::memory_order_release);
+        pending++;
+        return true;
+    }
+
+    // Submits the queued entries and waits for at least one completion
+    bool submit_and_wait() {
+        while (true) {
+            const long submitted = syscall(__NR_io_uring_enter, fd, pending, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (submitted >= 0) {
+                pending -= static_cast<unsigned>(submitted);
+                return true;
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                return false;
+            }
+        }
+    }
+
+    bool pop(io_uring_cqe& cqe) {
+        const unsigned head = *cq_head;
+        if (head == std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire)) {
+            return false;
+        }
+        cqe = cqes[head & cq_mask];
+        std::atomic_ref<unsigned>(*cq_head).store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    int fd{-1};
+    void* sq_ring{MAP_FAILED};
+    void* cq_ring{MAP_FAILED};
+    io_uring_sqe* sqes{static_cast<io_uring_sqe*>(MAP_FAILED)};
+    size_t sq_ring_size{};
+    size_t cq_ring_size{};
+    size_t sqes_size{};
+
+    unsigned* sq_head{};
+    unsigned* sq_tail{};
+    unsigned* sq_array{};
+    unsigned sq_mask{};
+    unsigned sq_entries{};
+    unsigned* cq_head{};
+    unsigned* cq_tail{};
+    unsigned cq_mask{};
+    io_uring_cqe* cqes{};
+    unsigned pending{}; // queued, not submitted yet
+};
+
+// One file being read or written through the ring
+struct Async_IO::Ring_Job {
+    int fd{-1};
+    bool write{};
+    size_t index{};              // of the file, for reads
+    std::vector<std::byte> data; // for reads
+    Write_Job job;               // for writes
+    size_t size{};
+    size_t done{};
+};
+
+// Files in flight at once, each has at most one transfer queued
+static constexpr unsigned RING_DEPTH = 16;
+#else
+struct Io_Ring {};
+struct Async_IO::Ring_Job {};
+#endif
+
+Async_IO::Async_IO(std::span<const Batch_File> files, const Async_IO_Options& options) :
+    m_files(files), m_options(options), m_slots(files.size()) {
+#ifdef __linux__
+    if (m_options.allow_ring) {
+        auto ring = std::make_unique<Io_Ring>();
+        if (ring->open(2 * RING_DEPTH)) {
+            m_ring = std::move(ring);
+            m_threads.emplace_back(&Async_IO::ring_loop, this);
+            return;
+        }
+    }
+#endif
+    m_threads.emplace_back(&Async_IO::read_loop, this);
+    m_threads.emplace_back(&Async_IO::write_loop, this);
+}
+
+Async_IO::~Async_IO() {
+    finish();
+    {
+        std::lock_guard lock(m_lock);
+        m_stop = true;
+    }
+    m_changed.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+std::string_view Async_IO::backend() const {
+    return m_ring ? "io_uring" : "threads";
+}
+
+bool Async_IO::prefetch_done() {
+    // Skips the files the workers read themselves
+    while (m_next_prefetch < m_slots.size() && m_slots[m_next_prefetch].state != Read_State::Pending) {
+        m_next_prefetch++;
+    }
+    return m_stop || m_next_prefetch == m_slots.size();
+}
+
+bool Async_IO::can_prefetch() {
+    if (prefetch_done()) {
+        return false;
+    }
+    // A single file larger than the budget still goes through, on its own
+    return m_read_in_flight == 0 || m_read_in_flight + m_files[m_next_prefetch].size <= m_options.max_read_ahead;
+}
+
+bool Async_IO::take_prefetch(size_t& index) {
+    if (!can_prefetch()) {
+        return false;
+    }
+    index = m_next_prefetch++;
+    m_slots[index].state = Read_State::Loading;
+    m_read_in_flight += m_files[index].size;
+    return true;
+}
+
+std::optional<std::vector<std::byte>> Async_IO::read(const Batch_File& file) {
+    const size_t index = static_cast<size_t>(&file - m_files.data());
+    std::unique_lock lock(m_lock);
+    Read_Slot& slot = m_slots[index];
+    if (slot.state == Read_State::Pending) {
+        // The prefetch is behind, waiting for it would only be slower
+        slot.state = Read_State::Taken;
+        lock.unlock();
+        return read_whole_file(file.input);
+    }
+
+    m_changed.wait(lock, [&] { return slot.state == Read_State::Ready || slot.state == Read_State::Failed; });
+    const bool ok = slot.state == Read_State::Ready;
+    std::vector<std::byte> data = std::move(slot.data);
+    slot.state = Read_State::Taken;
+    m_read_in_flight -= file.size;
+    lock.unlock();
+    m_changed.notify_all();
+
+    if (!ok) {
+        return std::nullopt;
+    }
+    return data;
+}
+
+void Async_IO::finish_read(size_t index, std::vector<std::byte>&& data, bool ok) {
+    {
+        std::lock_guard lock(m_lock);
+        m_slots[index].data = std::move(data);
+        m_slots[index].state = ok ? Read_State::Ready : Read_State::Failed;
+    }
+    m_changed.notify_all();
+}
+
+void Async_IO::write(const std::filesystem::path& path, Output_Buffer& data, std::function<void(bool written)> done) {
+    std::unique_lock lock(m_lock);
+    const size_t size = data.size();
+    m_changed.wait(lock, [&] { return m_write_in_flight == 0 || m_write_in_flight + size <= m_options.max_write_behind; });
+
+    Write_Job job{path, {}, std::move(done)};
+    std::swap(job.data, data);
+    if (!m_spare_buffers.empty()) {
+        data = std::move(m_spare_buffers.back());
+        m_spare_buffers.pop_back();
+    }
+    m_write_in_flight += size;
+    m_writes.push_back(std::move(job));
+    lock.unlock();
+    m_changed.notify_all();
+}
+
+void Async_IO::finish_write(Write_Job& job, bool ok) {
+    if (!ok) {
+        fprintf(stderr, "Unable to write %s\n", job.path.string().c_str());
+    }
+    // Before the job counts as done, so finish() waits for the callbacks too
+    if (job.done) {
+        job.done(ok);
+    }
+
+    {
+        std::lock_guard lock(m_lock);
+        m_write_in_flight -= job.data.size();
+        m_writes_active--;
+        m_failed_writes += ok ? 0 : 1;
+        // Grown buffers go back to the workers, a few are enough to never allocate again
+        job.data.clear();
+        if (m_spare_buffers.size() < 4) {
+            m_spare_buffers.push_back(std::move(job.data));
+        }
+    }
+    m_changed.notify_all();
+}
+
+size_t Async_IO::finish() {
+    std::unique_lock lock(m_lock);
+    m_changed.wait(lock, [&] { return m_writes.empty() && m_writes_active == 0; });
+    return m_failed_writes;
+}
+
+void Async_IO::read_loop() {
+    std::unique_lock lock(m_lock);
+    while (true) {
+        m_changed.wait(lock, [&] { return prefetch_done() || can_prefetch(); });
+        size_t index;
+        if (!take_prefetch(index)) {
+            return;
+        }
+        lock.unlock();
+        auto data = read_whole_file(m_files[index].input);
+        finish_read(index, data ? std::move(*data) : std::vector<std::byte>{}, data.has_value());
+        lock.lock();
+    }
+}
+
+void Async_IO::write_loop() {
+    std::unique_lock lock(m_lock);
+    while (true) {
+        m_changed.wait(lock, [&] { return m_stop || !m_writes.empty(); });
+        if (m_writes.empty()) {
+            return;
+        }
+        Write_Job job = std::move(m_writes.front());
+        m_writes.pop_front();
+        m_writes_active++;
+        lock.unlock();
+        finish_write(job, write_whole_file(job.path, job.data));
+        lock.lock();
+    }
+}
+
+#ifdef __linux__
+void Async_IO::ring_loop() {
+    Io_Ring& ring = *m_ring;
+    std::vector<std::unique_ptr<Ring_Job>> active;
+    std::vector<std::unique_ptr<Ring_Job>> started;
+
+    // Queues the next chunk of a job, reads and writes are capped below the 32 bit length of an entry
+    const auto queue_transfer = [&](Ring_Job& job) {
+        io_uring_sqe sqe;
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = job.write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe.fd = job.fd;
+        const void* buffer = job.write ? static_cast<const void*>(job.job.data.data() + job.done) : job.data.data() + job.done;
+        sqe.addr = reinterpret_cast<u64>(buffer);
+        sqe.len = static_cast<u32>(std::min<size_t>(job.size - job.done, 1 << 30));
+        sqe.off = job.done;
+        sqe.user_data = reinterpret_cast<u64>(&job);
+        ring.queue(sqe);
+    };
+
+    const auto complete = [&](Ring_Job& job, bool ok) {
+        if (job.fd >= 0 && close(job.fd) != 0) {
+            ok &= !job.write; // a failed close can lose written data
+        }
+        if (job.write) {
+            finish_write(job.job, ok);
+        } else {
+            finish_read(job.index, std::move(job.data), ok);
+        }
+    };
+
+    // Opens the file and queues the first transfer, false when the job is already over
+    const auto start = [&](Ring_Job& job) {
+        if (job.write) {
+            job.fd = open(job.job.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            job.size = job.job.data.size();
+        } else {
+            job.fd = open(m_files[job.index].input.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat info;
+            if (job.fd >= 0 && fstat(job.fd, &info) == 0) {
+                job.size = static_cast<size_t>(info.st_size);
+                job.data.resize(job.size);
+            }
+        }
+        if (job.fd < 0 || job.size == 0) {
+            complete(job, job.fd >= 0);
+            return false;
+        }
+        queue_transfer(job);
+        return true;
+    };
+
+    while (true) {
+        {
+            std::unique_lock lock(m_lock);
+            if (active.empty()) {
+                m_changed.wait(lock, [&] { return m_stop || !m_writes.empty() || can_prefetch(); });
+                if (m_writes.empty() && !can_prefetch()) {
+                    return;
+                }
+            }
+            // Writes first, workers may be waiting for them to free up the budget
+            while (active.size() + started.size() < RING_DEPTH) {
+                auto job = std::make_unique<Ring_Job>();
+                if (!m_writes.empty()) {
+                    job->write = true;
+                    job->job = std::move(m_writes.front());
+                    m_writes.pop_front();
+                    m_writes_active++;
+                } else if (!take_prefetch(job->index)) {
+                    break;
+                }
+                started.push_back(std::move(job));
+            }
+        }
+
+        for (auto& job : started) {
+            if (start(*job)) {
+                active.push_back(std::move(job));
+            }
+        }
+        started.clear();
+        if (active.empty()) {
+            continue;
+        }
+
+        if (!ring.submit_and_wait()) {
+            // The kernel holds pointers into the jobs, there is no safe way to carry on
+            fprintf(stderr, "io_uring_enter failed : %s\n", std::strerror(errno));
+            std::abort();
+        }
+
+        io_uring_cqe cqe;
+        while (ring.pop(cqe)) {
+            Ring_Job& job = *reinterpret_cast<Ring_Job*>(cqe.user_data);
+            if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                queue_transfer(job);
+                continue;
+            }
+            if (cqe.res > 0) {
+                job.done += static_cast<size_t>(cqe.res);
+                if (job.done < job.size) {
+                    queue_transfer(job);
+                    continue;
+                }
+            }
+
+            // A read coming up short means the file shrank since it was opened, what's there is the file
+            const bool ok = cqe.res > 0 || (cqe.res == 0 && !job.write);
+            if (ok && !job.write) {
+                job.data.resize(job.done);
+            }
+            complete(job, ok);
+            std::erase_if(active, [&](const std::unique_ptr<Ring_Job>& entry) { return entry.get() == &job; });
+        }
+    }
+}
+#else
+void Async_IO::ring_loop() {
+}
+#endif
@@ -0,0 +1,105 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "output-buffer.h"
+#include "scheduler.h"
+#include "types.h"
+
+struct Io_Ring;
+
+struct Async_IO_Options {
+    size_t max_read_ahead{64 << 20};   // bytes read but not yet taken by a worker
+    size_t max_write_behind{64 << 20}; // bytes handed over but not yet written
+    bool allow_ring{true};             // false always uses the threads
+};
+
+// Reads the inputs of a batch ahead of the workers and writes their outputs behind them, so disk time overlaps decoding.
+// Inputs are prefetched in batch order, largest first, like the pool hands them out. On Linux the transfers go through
+// io_uring, elsewhere or when the kernel refuses a ring through two background threads doing plain file I/O.
+class Async_IO {
+public:
+    Async_IO(std::span<const Batch_File> files, const Async_IO_Options& options = {});
+    // Waits for the outstanding writes
+    ~Async_IO();
+
+    Async_IO(const Async_IO&) = delete;
+    Async_IO& operator=(const Async_IO&) = delete;
+
+    // Contents of file, which must be one of the files given to the constructor. Waits when it is being prefetched,
+    // and reads it on the spot when the prefetch hasn't got to it yet. nullopt when it can't be read.
+    std::optional<std::vector<std::byte>> read(const Batch_File& file);
+
+    // Queues data to be written to path, and hands back an empty buffer in its place.
+    // done is called with whether the write succeeded, from the I/O thread. Waits while too much is queued already.
+    void write(const std::filesystem::path& path, Output_Buffer& data, std::function<void(bool written)> done = {});
+
+    // Waits for every queued write, returns how many of them failed
+    size_t finish();
+
+    std::string_view backend() const;
+
+private:
+    enum class Read_State {
+        Pending,  // not reached by the prefetch yet
+        Loading,
+        Ready,
+        Failed,
+        Taken,    // by a worker, either from the prefetch or read on the spot
+    };
+
+    struct Read_Slot {
+        Read_State state{Read_State::Pending};
+        std::vector<std::byte> data;
+    };
+
+    struct Write_Job {
+        std::filesystem::path path;
+        Output_Buffer data;
+        std::function<void(bool)> done;
+    };
+
+    struct Ring_Job;
+
+    // These three expect m_lock to be held
+    bool prefetch_done();
+    bool can_prefetch();
+    bool take_prefetch(size_t& index);
+
+    void finish_read(size_t index, std::vector<std::byte>&& data, bool ok);
+    void finish_write(Write_Job& job, bool ok);
+
+    void read_loop();
+    void write_loop();
+    void ring_loop();
+
+    std::span<const Batch_File> m_files;
+    Async_IO_Options m_options;
+    std::unique_ptr<Io_Ring> m_ring; // nullptr when the threads do the I/O
+
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+
+    std::vector<Read_Slot> m_slots;
+    size_t m_next_prefetch{};
+    size_t m_read_in_flight{};
+
+    std::deque<Write_Job> m_writes;
+    size_t m_writes_active{};
+    size_t m_write_in_flight{};
+    size_t m_failed_writes{};
+    std::vector<Output_Buffer> m_spare_buffers;
+
+    bool m_stop{};
+    std::vector<std::thread> m_threads;
+};
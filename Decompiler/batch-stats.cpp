@@ -0,0 +1,199 @@
+#include "batch-stats.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static Alloc_Stats total_allocations(const Script_Stats& stats) {
+    Alloc_Stats total;
+    for (const auto& phase : stats.allocations) {
+        total.add(phase);
+    }
+    return total;
+}
+
+// Where the script sits under the batch input, so equal names in different subdirectories stay apart
+static std::string display_path(const std::filesystem::path& input, const std::filesystem::path& root) {
+    const std::filesystem::path relative = input.lexically_relative(root);
+    return (relative.empty() ? input.filename() : relative).generic_string();
+}
+
+static void print_alloc_table(std::span<const File_Stats> files, const std::filesystem::path& root, const Script_Stats& total, FILE* out) {
+    fprintf(out, "\n%-12s %12s %12s %12s\n", "phase", "allocations", "allocated", "peak");
+    for (size_t i = 0; i < STATS_PHASE_COUNT; i++) {
+        const Alloc_Stats& phase = total.allocations[i];
+        if (phase.count == 0) continue;
+        const std::string_view name = stats_phase_name(static_cast<Stats_Phase>(i));
+        fprintf(out, "%-12.*s %12llu %10.2fMB %10.1fkB\n", (int)name.size(), name.data(), static_cast<unsigned long long>(phase.count),
+                phase.bytes / 1e6, phase.peak / 1e3);
+    }
+    const Alloc_Stats sum = total_allocations(total);
+    fprintf(out, "%-12s %12llu %10.2fMB %10.1fkB\n", "total", static_cast<unsigned long long>(sum.count), sum.bytes / 1e6, sum.peak / 1e3);
+
+    // Files making the most allocations first
+    std::vector<const File_Stats*> busiest;
+    for (const auto& file : files) {
+        busiest.push_back(&file);
+    }
+    const size_t shown = std::min<size_t>(busiest.size(), 10);
+    std::ranges::partial_sort(busiest, busiest.begin() + shown, std::ranges::greater{},
+                              [](const File_Stats* file) { return total_allocations(file->stats).count; });
+
+    fprintf(out, "\n%-40s %12s %12s %12s %12s\n", "most allocations", "allocations", "per instr", "allocated", "peak");
+    for (size_t i = 0; i < shown; i++) {
+        const Alloc_Stats file = total_allocations(busiest[i]->stats);
+        fprintf(out, "%-40s %12llu %12.2f %10.2fMB %10.1fkB\n", display_path(busiest[i]->input, root).c_str(), static_cast<unsigned long long>(file.count),
+                static_cast<double>(file.count) / std::max<u64>(busiest[i]->stats.instructions, 1), file.bytes / 1e6, file.peak / 1e3);
+    }
+}
+
+void print_stats_table(std::span<const File_Stats> files, const std::filesystem::path& root, FILE* out) {
+    Script_Stats total;
+    for (const auto& file : files) {
+        total.add(file.stats);
+    }
+    const double total_time = static_cast<double>(std::max<u64>(total.total_time(), 1));
+
+    fprintf(out, "\n%zu files, %.2f MB in, %.2f MB out, %llu instructions, %llu strings, %llu arrays, %llu labels\n", files.size(),
+            total.bytes_in / 1e6, total.bytes_out / 1e6, static_cast<unsigned long long>(total.instructions),
+            static_cast<unsigned long long>(total.strings), static_cast<unsigned long long>(total.arrays), static_cast<unsigned long long>(total.labels));
+    fprintf(out, "\n%-12s %12s %8s\n", "phase", "time", "share");
+    for (size_t i = 0; i < STATS_PHASE_COUNT; i++) {
+        if (total.nanoseconds[i] == 0) continue;
+        const std::string_view name = stats_phase_name(static_cast<Stats_Phase>(i));
+        fprintf(out, "%-12.*s %10.3fms %7.1f%%\n", (int)name.size(), name.data(), total.nanoseconds[i] / 1e6, 100.0 * total.nanoseconds[i] / total_time);
+    }
+    fprintf(out, "%-12s %10.3fms\n", "total", total_time / 1e6);
+
+    // Slowest scripts first
+    std::vector<const File_Stats*> slowest;
+    for (const auto& file : files) {
+        slowest.push_back(&file);
+    }
+    const size_t shown = std::min<size_t>(slowest.size(), 10);
+    std::ranges::partial_sort(slowest, slowest.begin() + shown, std::ranges::greater{}, [](const File_Stats* file) { return file->stats.total_time(); });
+
+    fprintf(out, "\n%-40s %12s %12s %s\n", "slowest files", "time", "instructions", "main phase");
+    for (size_t i = 0; i < shown; i++) {
+        const Script_Stats& stats = slowest[i]->stats;
+        const auto main_phase = std::ranges::max_element(stats.nanoseconds) - stats.nanoseconds.begin();
+        const std::string_view name = stats_phase_name(static_cast<Stats_Phase>(main_phase));
+        fprintf(out, "%-40s %10.3fms %12llu %.*s\n", display_path(slowest[i]->input, root).c_str(), stats.total_time() / 1e6,
+                static_cast<unsigned long long>(stats.instructions), (int)name.size(), name.data());
+    }
+
+    if constexpr (ALLOC_PROFILE) {
+        print_alloc_table(files, root, total, out);
+    }
+}
+
+static void append_number(u64 value, std::string& output) {
+    output.append(std::to_string(value));
+}
+
+static void append_csv_path(const std::filesystem::path& path, std::string& output) {
+    const std::string text = path.generic_string();
+    if (text.find_first_of(",\"\r\n") == std::string::npos) {
+        output.append(text);
+        return;
+    }
+    output.push_back('"');
+    for (const char c : text) {
+        if (c == '"') output.push_back('"');
+        output.push_back(c);
+    }
+    output.push_back('"');
+}
+
+static void append_json_path(const std::filesystem::path& path, std::string& output) {
+    output.push_back('"');
+    for (const char c : path.generic_string()) {
+        if (c == '"' || c == '\\') {
+            output.push_back('\\');
+        }
+        if (static_cast<unsigned char>(c) >= 0x20) {
+            output.push_back(c);
+        }
+    }
+    output.push_back('"');
+}
+
+bool write_stats(std::span<const File_Stats> files, const std::filesystem::path& path) {
+    static constexpr std::array<std::string_view, 6> COUNTERS{"bytes_in", "bytes_out", "instructions", "strings", "arrays", "labels"};
+    const auto counters = [](const Script_Stats& stats) {
+        return std::array<u64, 6>{stats.bytes_in, stats.bytes_out, stats.instructions, stats.strings, stats.arrays, stats.labels};
+    };
+
+    std::string output;
+    if (path.extension() == ".json") {
+        output.append("[");
+        for (size_t f = 0; f < files.size(); f++) {
+            output.append(f == 0 ? "\n  {\"file\": " : ",\n  {\"file\": ");
+            append_json_path(files[f].input, output);
+            const auto values = counters(files[f].stats);
+            for (size_t i = 0; i < COUNTERS.size(); i++) {
+                output.append(", \"").append(COUNTERS[i]).append("\": ");
+                append_number(values[i], output);
+            }
+            // Phase times in microseconds
+            for (size_t i = 0; i < STATS_PHASE_COUNT; i++) {
+                output.append(", \"").append(stats_phase_name(static_cast<Stats_Phase>(i))).append("_us\": ");
+                append_number(files[f].stats.nanoseconds[i] / 1000, output);
+            }
+            if constexpr (ALLOC_PROFILE) {
+                for (size_t i = 0; i < STATS_PHASE_COUNT; i++) {
+                    const std::string_view name = stats_phase_name(static_cast<Stats_Phase>(i));
+                    const Alloc_Stats& phase = files[f].stats.allocations[i];
+                    output.append(", \"").append(name).append("_allocs\": ");
+                    append_number(phase.count, output);
+                    output.append(", \"").append(name).append("_alloc_bytes\": ");
+                    append_number(phase.bytes, output);
+                    output.append(", \"").append(name).append("_peak_bytes\": ");
+                    append_number(phase.peak, output);
+                }
+            }
+            output.push_back('}');
+        }
+        output.append("\n]\n");
+    } else {
+        output.append("file");
+        for (const auto counter : COUNTERS) {
+            output.append(",").append(counter);
+        }
+        for (size_t i = 0; i < STATS_PHASE_COUNT; i++) {
+            output.append(",").append(stats_phase_name(static_cast<Stats_Phase>(i))).append("_us");
+        }
+        if constexpr (ALLOC_PROFILE) {
+            for (size_t i = 0; i < STATS_PHASE_COUNT; i++) {
+                const std::string_view name = stats_phase_name(static_cast<Stats_Phase>(i));
+                output.append(",").append(name).append("_allocs,").append(name).append("_alloc_bytes,").append(name).append("_peak_bytes");
+            }
+        }
+        output.push_back('\n');
+
+        for (const auto& file : files) {
+            append_csv_path(file.input, output);
+            for (const u64 value : counters(file.stats)) {
+                output.push_back(',');
+                append_number(value, output);
+            }
+            for (const u64 time : file.stats.nanoseconds) {
+                output.push_back(',');
+                append_number(time / 1000, output);
+            }
+            if constexpr (ALLOC_PROFILE) {
+                for (const auto& phase : file.stats.allocations) {
+                    for (const u64 value : {phase.count, phase.bytes, phase.peak}) {
+                        output.push_back(',');
+                        append_number(value, output);
+                    }
+                }
+            }
+            output.push_back('\n');
+        }
+    }
+
+    std::ofstream fd_out(path, std::ios::out | std::ios::binary);
+    return static_cast<bool>(fd_out.write(output.data(), output.size()));
+}
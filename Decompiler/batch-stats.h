@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdio>
+#include <filesystem>
+#include <span>
+
+#include "script-stats.h"
+
+struct File_Stats {
+    std::filesystem::path input;
+    Script_Stats stats;
+};
+
+// Totals per phase over the whole batch, then the slowest scripts with the phase which dominated each of them.
+// AGE_ALLOC_PROFILE builds add the heap use per phase and the scripts making the most allocations.
+// Scripts are named by their path relative to root, the directory the batch was given.
+void print_stats_table(std::span<const File_Stats> files, const std::filesystem::path& root, FILE* out);
+
+// One record per file, as CSV or JSON depending on the extension of path
+bool write_stats(std::span<const File_Stats> files, const std::filesystem::path& path);
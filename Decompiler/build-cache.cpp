@@ -0,0 +1,87 @@
+#include "build-cache.h"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+static constexpr std::string_view MANIFEST_MAGIC = "age-asm build cache";
+
+Build_Cache::Build_Cache(std::filesystem::path manifest, u64 version) :
+    m_manifest(std::move(manifest)),
+    m_version(version) {
+    std::ifstream fd_in(m_manifest, std::ios::in | std::ios::binary);
+    if (!fd_in.is_open()) {
+        return;
+    }
+
+    // First line : magic and version. Then one "hash size path" line per output.
+    std::string line;
+    u64 version_read{};
+    if (!std::getline(fd_in, line) || !line.starts_with(MANIFEST_MAGIC) || line.size() <= MANIFEST_MAGIC.size() ||
+        std::from_chars(line.data() + MANIFEST_MAGIC.size() + 1, line.data() + line.size(), version_read, 16).ec != std::errc{} ||
+        version_read != m_version) {
+        return;
+    }
+
+    while (std::getline(fd_in, line)) {
+        Entry entry{};
+        const char* const end = line.data() + line.size();
+        auto result = std::from_chars(line.data(), end, entry.input_hash, 16);
+        if (result.ec != std::errc{} || result.ptr == end) continue;
+        result = std::from_chars(result.ptr + 1, end, entry.output_size, 16);
+        if (result.ec != std::errc{} || result.ptr == end) continue;
+
+        m_previous.insert_or_assign(std::string{result.ptr + 1, end}, entry);
+    }
+}
+
+std::string Build_Cache::key(const std::filesystem::path& output) const {
+    return output.lexically_relative(m_manifest.parent_path()).generic_string();
+}
+
+bool Build_Cache::is_up_to_date(const std::filesystem::path& output, u64 input_hash, u64& output_size) const {
+    const auto it = m_previous.find(key(output));
+    if (it == m_previous.end() || it->second.input_hash != input_hash) {
+        return false;
+    }
+
+    // Catches outputs deleted or touched by something else since
+    std::error_code error;
+    const auto size = std::filesystem::file_size(output, error);
+    if (error || size != it->second.output_size) {
+        return false;
+    }
+    output_size = size;
+    return true;
+}
+
+void Build_Cache::update(const std::filesystem::path& output, u64 input_hash, u64 output_size) {
+    std::lock_guard lock(m_lock);
+    m_current.insert_or_assign(key(output), Entry{input_hash, output_size});
+}
+
+void Build_Cache::save() const {
+    std::ofstream fd_out(m_manifest, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!fd_out.is_open()) {
+        fprintf(stderr, "Unable to write the build cache %s.\n", m_manifest.string().c_str());
+        return;
+    }
+
+    char number[17];
+    const auto hex = [&](u64 value) {
+        return std::string_view{number, static_cast<size_t>(std::to_chars(number, number + sizeof(number), value, 16).ptr - number)};
+    };
+
+    // Sorted by path, so identical runs write identical manifests
+    std::vector<std::pair<std::string_view, Entry>> entries(m_current.begin(), m_current.end());
+    std::ranges::sort(entries, {}, [](const auto& entry) { return entry.first; });
+
+    fd_out << MANIFEST_MAGIC << ' ' << hex(m_version) << '\n';
+    for (const auto& [path, entry] : entries) {
+        fd_out << hex(entry.input_hash) << ' ';
+        fd_out << hex(entry.output_size) << ' ' << path << '\n';
+    }
+}
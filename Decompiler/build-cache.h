@@ -0,0 +1,40 @@
+#pragma once
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "types.h"
+
+// Manifest of a batch assembly, kept in the output directory : for every output, the hash of the input it was built from
+// and its size. A file whose input hash, tool version and output size all match is up to date and can be skipped.
+// Lookups are lock free, updates may come from any worker.
+class Build_Cache {
+public:
+    // Loads the manifest if there is one and it was written with the same version
+    Build_Cache(std::filesystem::path manifest, u64 version);
+
+    // output_size is set to the size of the output when it is up to date
+    bool is_up_to_date(const std::filesystem::path& output, u64 input_hash, u64& output_size) const;
+
+    // Records the state of an output built (or found up to date) during this run
+    void update(const std::filesystem::path& output, u64 input_hash, u64 output_size);
+
+    // Writes every output recorded during this run, forgetting those which weren't
+    void save() const;
+
+private:
+    struct Entry {
+        u64 input_hash;
+        u64 output_size;
+    };
+
+    std::string key(const std::filesystem::path& output) const;
+
+    std::filesystem::path m_manifest;
+    u64 m_version;
+    std::unordered_map<std::string, Entry> m_previous;
+
+    std::mutex m_lock;
+    std::unordered_map<std::string, Entry> m_current;
+};
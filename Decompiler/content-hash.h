@@ -0,0 +1,65 @@
+#pragma once
+#include <bit>
+#include <cstring>
+#include <span>
+
+#include "types.h"
+
+// XXH64 : fast, well distributed 64 bit hash of file contents, for change detection (not cryptographic).
+inline u64 content_hash(std::span<const std::byte> data, u64 seed = 0) {
+    constexpr u64 PRIME_1 = 0x9E3779B185EBCA87ull;
+    constexpr u64 PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr u64 PRIME_3 = 0x165667B19E3779F9ull;
+    constexpr u64 PRIME_4 = 0x85EBCA77C2B2AE63ull;
+    constexpr u64 PRIME_5 = 0x27D4EB2F165667C5ull;
+
+    const auto read64 = [](const std::byte* p) { u64 v; std::memcpy(&v, p, sizeof(v)); return v; };
+    const auto read32 = [](const std::byte* p) { u32 v; std::memcpy(&v, p, sizeof(v)); return v; };
+    const auto round = [](u64 acc, u64 input) { return std::rotl(acc + input * PRIME_2, 31) * PRIME_1; };
+    const auto merge = [&](u64 acc, u64 value) { return (acc ^ round(0, value)) * PRIME_1 + PRIME_4; };
+
+    const std::byte* p = data.data();
+    const std::byte* const end = p + data.size();
+    u64 hash;
+
+    if (data.size() >= 32) {
+        u64 v1 = seed + PRIME_1 + PRIME_2;
+        u64 v2 = seed + PRIME_2;
+        u64 v3 = seed;
+        u64 v4 = seed - PRIME_1;
+        do {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+
+        hash = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+        hash = merge(hash, v1);
+        hash = merge(hash, v2);
+        hash = merge(hash, v3);
+        hash = merge(hash, v4);
+    } else {
+        hash = seed + PRIME_5;
+    }
+
+    hash += data.size();
+    for (; end - p >= 8; p += 8) {
+        hash = std::rotl(hash ^ round(0, read64(p)), 27) * PRIME_1 + PRIME_4;
+    }
+    if (end - p >= 4) {
+        hash = std::rotl(hash ^ (read32(p) * PRIME_1), 23) * PRIME_2 + PRIME_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        hash = std::rotl(hash ^ (static_cast<u8>(*p) * PRIME_5), 11) * PRIME_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,279 @@
+#include "corpus-bench.h"
+#include "libage.h"
+#include "perf-counters.h"
+#include "scheduler.h"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+
+enum class Pipeline {
+    Disassemble,
+    Assemble,
+    Round_Trip,
+};
+
+static constexpr std::array PIPELINES{Pipeline::Disassemble, Pipeline::Assemble, Pipeline::Round_Trip};
+
+static std::string_view pipeline_name(Pipeline pipeline) {
+    switch (pipeline) {
+    case Pipeline::Disassemble: return "disassemble";
+    case Pipeline::Assemble:    return "assemble";
+    case Pipeline::Round_Trip:  return "round-trip";
+    }
+    return "";
+}
+
+struct Corpus_Script {
+    std::filesystem::path path;
+    std::vector<std::byte> binary;
+    std::string text;
+};
+
+struct Bench_Result {
+    Pipeline pipeline;
+    size_t threads;
+    double median;  // seconds
+    double p95;     // seconds
+    double mb_per_second;
+    double instructions_per_second;
+    double speedup; // over the single thread median
+    Perf_Counters::Counts counters; // per run
+    bool counters_available;
+};
+
+// Everything a worker reuses between scripts
+struct Bench_Scratch {
+    Output_Buffer first;
+    Output_Buffer second;
+    Scratch_Arena arena;
+};
+
+static double percentile(std::vector<double> samples, double fraction) {
+    std::ranges::sort(samples);
+    // Nearest rank
+    const size_t rank = static_cast<size_t>(std::ceil(fraction * samples.size()));
+    return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+}
+
+static void append_json_string(std::string_view text, std::string& json) {
+    json.push_back('"');
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            json.push_back('\\');
+            json.push_back(c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            json.append(escaped);
+        } else {
+            json.push_back(c);
+        }
+    }
+    json.push_back('"');
+}
+
+int run_corpus_bench(const Corpus_Bench_Options& options) {
+    const auto files = collect_batch_files(options.corpus, {".bin"});
+    if (files.empty()) {
+        fprintf(stderr, "No scripts found in %s\n", options.corpus.string().c_str());
+        return -1;
+    }
+
+    // Load every script and its text form once
+    std::vector<Corpus_Script> scripts;
+    u64 binary_bytes = 0;
+    u64 text_bytes = 0;
+    u64 instructions = 0;
+    size_t mismatches = 0;
+    for (const auto& file : files) {
+        Mapped_File fd_in(file.input);
+        if (!fd_in.is_open()) {
+            fprintf(stderr, "Unable to open %s, skipping.\n", file.input.string().c_str());
+            continue;
+        }
+
+        Corpus_Script script{file.input, {fd_in.data().begin(), fd_in.data().end()}, {}};
+        Output_Buffer text;
+        const Result result = disassemble(script.binary, text);
+        if (!result) {
+            fprintf(stderr, "Unable to disassemble %s, skipping : %s\n", file.input.string().c_str(), result.error.c_str());
+            continue;
+        }
+        script.text = text.view();
+
+        // Checked once here, the timed round trips only measure
+        Output_Buffer binary;
+        if (!assemble(script.text, binary) ||
+            binary.view() != std::string_view{reinterpret_cast<const char*>(script.binary.data()), script.binary.size()}) {
+            mismatches++;
+        }
+
+        Header header(script.binary);
+        Script parsed;
+        parse_script(script.binary, header, parsed, Parse_Mode::Layout);
+        instructions += parsed.instructions.size();
+        binary_bytes += script.binary.size();
+        text_bytes += script.text.size();
+        scripts.push_back(std::move(script));
+    }
+
+    std::vector<size_t> thread_counts;
+    for (size_t threads = 1; threads < options.max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(std::max<size_t>(options.max_threads, 1));
+
+    fprintf(stdout, "%zu scripts, %.2f MB compiled, %.2f MB of text, %llu instructions, %u runs each\n\n", scripts.size(),
+            binary_bytes / 1e6, text_bytes / 1e6, static_cast<unsigned long long>(instructions), options.runs);
+    fprintf(stdout, "%-12s %7s %10s %10s %10s %12s %8s\n", "pipeline", "threads", "median", "p95", "MB/s", "Minstr/s", "speedup");
+
+    std::vector<Bench_Result> results;
+    for (const Pipeline pipeline : PIPELINES) {
+        const u64 input_bytes = pipeline == Pipeline::Assemble ? text_bytes : binary_bytes;
+        double single_thread = 0;
+
+        for (const size_t threads : thread_counts) {
+            std::vector<double> samples;
+            // Opened before the pool starts its threads, so they are counted too
+            Perf_Counters counters;
+            {
+                Thread_Pool pool(threads);
+                std::vector<Bench_Scratch> scratch(pool.size());
+                const auto task = [&](size_t worker, size_t index) {
+                    auto& [first, second, arena] = scratch[worker];
+                    const Corpus_Script& script = scripts[index];
+                    first.clear();
+                    second.clear();
+                    switch (pipeline) {
+                    case Pipeline::Disassemble:
+                        disassemble(script.binary, first, &arena);
+                        break;
+                    case Pipeline::Assemble:
+                        assemble(script.text, first, &arena);
+                        break;
+                    case Pipeline::Round_Trip:
+                        disassemble(script.binary, first, &arena);
+                        arena.reset();
+                        assemble(first.view(), second, &arena);
+                        break;
+                    }
+                    arena.reset();
+                };
+
+                pool.run(scripts.size(), task); // warms up the caches and grows the buffers
+                counters.start();
+                for (u32 run = 0; run < options.runs; run++) {
+                    const auto start = std::chrono::steady_clock::now();
+                    pool.run(scripts.size(), task);
+                    const auto end = std::chrono::steady_clock::now();
+                    samples.push_back(std::chrono::duration<double>(end - start).count());
+                }
+            }
+
+            Bench_Result& result = results.emplace_back();
+            result.pipeline = pipeline;
+            result.threads = threads;
+            result.median = percentile(samples, 0.5);
+            result.p95 = percentile(samples, 0.95);
+            result.mb_per_second = input_bytes / result.median / 1e6;
+            result.instructions_per_second = instructions / result.median;
+            if (threads == 1) {
+                single_thread = result.median;
+            }
+            result.speedup = single_thread > 0 ? single_thread / result.median : 1;
+            result.counters = counters.stop();
+            result.counters_available = counters.available();
+            for (auto& count : result.counters) {
+                count /= std::max<u32>(options.runs, 1);
+            }
+
+            fprintf(stdout, "%-12.*s %7zu %8.2fms %8.2fms %10.2f %12.2f %7.2fx\n", (int)pipeline_name(pipeline).size(), pipeline_name(pipeline).data(),
+                    threads, result.median * 1e3, result.p95 * 1e3, result.mb_per_second, result.instructions_per_second / 1e6, result.speedup);
+            if (result.counters_available) {
+                const auto& counts = result.counters;
+                fprintf(stdout, "%20s %.3f IPC, %llu cycles, %llu cache misses, %llu branch misses per run\n", "",
+                        counts[Perf_Counters::Cycles] ? static_cast<double>(counts[Perf_Counters::Instructions]) / counts[Perf_Counters::Cycles] : 0.0,
+                        static_cast<unsigned long long>(counts[Perf_Counters::Cycles]),
+                        static_cast<unsigned long long>(counts[Perf_Counters::Cache_Misses]),
+                        static_cast<unsigned long long>(counts[Perf_Counters::Branch_Misses]));
+            }
+        }
+    }
+
+    if (!results.empty() && !results.front().counters_available) {
+        fprintf(stdout, "\nHardware counters are not available here.\n");
+    }
+    if (mismatches > 0) {
+        fprintf(stdout, "\n%zu scripts did not round trip binary identical, check the corpus with -x.\n", mismatches);
+    }
+
+    if (!options.json_output.empty()) {
+        std::string json;
+        char number[64];
+        const auto field = [&](std::string_view name, double value, const char* format) {
+            append_json_string(name, json);
+            snprintf(number, sizeof(number), format, value);
+            json.append(": ").append(number);
+        };
+
+        json.append("{\n  \"corpus\": ");
+        append_json_string(options.corpus.generic_string(), json);
+        snprintf(number, sizeof(number), "%016llx", static_cast<unsigned long long>(op_code_table_version()));
+        json.append(",\n  \"op_code_table_version\": ");
+        append_json_string(number, json);
+        json.append(",\n  ");
+        field("scripts", static_cast<double>(scripts.size()), "%.0f");
+        json.append(",\n  ");
+        field("compiled_bytes", static_cast<double>(binary_bytes), "%.0f");
+        json.append(",\n  ");
+        field("text_bytes", static_cast<double>(text_bytes), "%.0f");
+        json.append(",\n  ");
+        field("instructions", static_cast<double>(instructions), "%.0f");
+        json.append(",\n  ");
+        field("runs", options.runs, "%.0f");
+        json.append(",\n  ");
+        field("round_trip_mismatches", static_cast<double>(mismatches), "%.0f");
+        json.append(",\n  \"results\": [");
+
+        for (size_t i = 0; i < results.size(); i++) {
+            const Bench_Result& result = results[i];
+            json.append(i == 0 ? "\n    {" : ",\n    {");
+            json.append("\"pipeline\": ");
+            append_json_string(pipeline_name(result.pipeline), json);
+            json.append(", ");
+            field("threads", static_cast<double>(result.threads), "%.0f");
+            json.append(", ");
+            field("median_seconds", result.median, "%.6f");
+            json.append(", ");
+            field("p95_seconds", result.p95, "%.6f");
+            json.append(", ");
+            field("mb_per_second", result.mb_per_second, "%.3f");
+            json.append(", ");
+            field("instructions_per_second", result.instructions_per_second, "%.0f");
+            json.append(", ");
+            field("speedup", result.speedup, "%.3f");
+            if (result.counters_available) {
+                json.append(", \"counters\": {");
+                for (size_t c = 0; c < Perf_Counters::COUNTER_COUNT; c++) {
+                    if (c > 0) json.append(", ");
+                    field(Perf_Counters::name(static_cast<Perf_Counters::Counter>(c)), static_cast<double>(result.counters[c]), "%.0f");
+                }
+                json.push_back('}');
+            }
+            json.push_back('}');
+        }
+        json.append("\n  ]\n}\n");
+
+        std::ofstream fd_out(options.json_output, std::ios::out | std::ios::binary);
+        if (!fd_out.write(json.data(), json.size())) {
+            fprintf(stderr, "Unable to write %s\n", options.json_output.string().c_str());
+            return -1;
+        }
+        fprintf(stdout, "\nResults written to %s\n", options.json_output.string().c_str());
+    }
+
+    return mismatches > 0 ? -1 : 0;
+}
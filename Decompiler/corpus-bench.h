@@ -0,0 +1,16 @@
+#pragma once
+#include <filesystem>
+
+#include "types.h"
+
+struct Corpus_Bench_Options {
+    std::filesystem::path corpus;     // directory of .bin scripts, searched recursively
+    u32 runs{5};                      // timed runs per pipeline and thread count
+    size_t max_threads{1};            // scaling is measured at 1, 2, 4, ... up to this
+    std::filesystem::path json_output; // where the results go as JSON, nowhere when empty
+};
+
+// End-to-end benchmark of the disassemble, assemble and round-trip pipelines over a whole corpus.
+// Scripts are loaded once and outputs stay in memory, so the numbers measure the tool rather than the disk.
+// Reports median / p95 wall time, MB/s, instructions/s and scaling per thread count, plus hardware counters where available.
+int run_corpus_bench(const Corpus_Bench_Options& options);
@@ -1,127 +1,100 @@
 #include "age-shared.h"
 #include "disassembler.h"
+#include "string-pool.h"
 
-#include <iostream>
-
-Instruction parse_instruction(std::istream& fd, Header& header, const Instruction_Definition* def, std::streamoff offset, std::streamoff* data_array_end) {
-    std::vector<Argument> arguments;
-    arguments.reserve(def->argument_count);
+void parse_instruction(std::span<const std::byte> data, size_t& cursor, Header& header, const Instruction_Definition* def, u32 offset, std::streamoff* data_array_end, Script& script, Parse_Mode mode, Script_Stats* stats) {
+    script.instructions.push_back({def, static_cast<u32>(script.arguments.size()), offset});
 
     for (u32 current{0}; current < def->argument_count; ++current) {
-        Argument& arg = arguments.emplace_back();
-        // reads only 2 uint32_t
-        fd >> arg;
+        Argument& arg = script.arguments.emplace_back();
+        arg.type = read_value<u32>(data, cursor);
+        arg.raw_data = read_value<u32>(data, cursor + sizeof(u32));
+        cursor += 2 * sizeof(u32);
 
         // If this instruction is a 'String' or copy-array argument, we have to alter data_array_end accordingly.
         if (arg.type == 2) {
             // Strings are all located at the end of the data array, XORed with 0xFF, and separated by 0xFF.
             std::streamoff string_offset = header.GetLength() + (static_cast<uint64_t>(arg.raw_data) << 2);
             *data_array_end = std::min(*data_array_end, string_offset);
+            if (mode == Parse_Mode::Layout) {
+                // The string stays where it is, and type 2 needs no further checks
+                continue;
+            }
+            Phase_Timer timer(stats, Stats_Phase::Transcode);
 
-            // mark current
-            std::streamoff cur_off = fd.tellg();
-
-            // jump to string offset
-            fd.seekg(string_offset, std::ios::beg);
-
-            // read the string, XOR'ing each character
-            std::string decoded;
-            decoded.reserve(32);
+            // decode the string straight out of the pool, the argument now refers to it in the side table
+            arg.raw_data = static_cast<u32>(script.string_offsets.size());
+            script.string_offsets.push_back(static_cast<u32>(script.string_data.size()));
 
+            bool terminated;
             if (header.IsVer5()) {
-                std::wstring utf16_decoded{};
-                u16 character{};
-                fd.read((char*)&character, sizeof(character));
-                while (character != 0xFFFF) {
-                    character ^= 0xFFFF;
-                    // flip the bytes, we need little endian
-                    //character = ((character & 0xFF00) >> 8) | ((character & 0xFF) << 8);
-                    utf16_decoded += character;
-                    fd.read((char*)&character, sizeof(character));
-                }
+                std::pmr::u16string utf16_decoded{script.resource()};
+                terminated = decode_pool_string(data, static_cast<size_t>(string_offset), utf16_decoded);
 
                 // convert it over to UTF8 for easier text editing
-                arg.decoded_stringv4 = utf16_to_cp(CP_UTF8, utf16_decoded);
+                utf16_to_utf8(utf16_decoded, script.string_data);
             } else {
                 // SJIS -> UTF8
-                u8 character{};
-                fd.read((char*)&character, sizeof(character));
-                while (character != 0xFF) {
-                    character ^= 0xFF;
-                    decoded += character;
-                    fd.read((char*)&character, sizeof(character));
-                }
+                std::pmr::string decoded{script.resource()};
+                terminated = decode_pool_string(data, static_cast<size_t>(string_offset), decoded);
 
                 // convert it over to UTF8 for easier text editing
-                arg.decoded_stringv4 = utf16_to_cp(CP_UTF8, cp_to_utf16(CP_932, decoded));
+                cp932_to_utf8(decoded, script.string_data);
             }
 
-            // Go back to the instruction position
-            fd.seekg(cur_off, std::ios::beg);
+            if (!terminated) {
+                fail("Unterminated string at 0x%llx", static_cast<long long>(string_offset));
+            }
         } else if (def->op_code == 0x64 && current == 1) {
             // This instruction actually references an array in the file's footer.
             std::streamoff array_offset = header.GetLength() + (static_cast<std::int64_t>(arg.raw_data) << 2);
             *data_array_end = std::min(*data_array_end, array_offset);
-
-            // mark current
-            std::streamoff cur_off = fd.tellg();
-
-            // Jump to array offset
-            fd.seekg(array_offset, std::ios::beg);
-
-            fd >> arg.data_array;
-
-            // Go back to the instruction position
-            fd.seekg(cur_off, std::ios::beg);
+            if (mode == Parse_Mode::Full) {
+                const u32 array_index = script.read_array(data, static_cast<size_t>(array_offset));
+                // Only untyped arguments are written out as arrays, others keep their value
+                if (arg.type == 0) {
+                    arg.raw_data = array_index;
+                }
+            }
         }
 
         if (arg.type < 0 || (arg.type > 0xE && arg.type < 0x8003) || arg.type > 0x800B) {
-            std::streamoff cur_off = fd.tellg();
-            fprintf(stderr, "Pos : %llx -> Opcode : %x, argument %d\n", cur_off, def->op_code, current);
-            fprintf(stderr, "Unknown type : %x\n", arg.type);
-            fprintf(stderr, "Value : %x\n", arg.raw_data);
-            exit(-1);
+            fail("Unknown type %x (value %x) at 0x%zx, op code %x argument %d", arg.type, arg.raw_data, cursor, def->op_code, current);
         }
     }
-
-    return Instruction(def, arguments, offset);
 }
 
-std::string disassemble_header(Header& header) {
+void disassemble_header(Header& header, Output_Buffer& output) {
     static constexpr std::string_view HEADER_PREFIX = "==Binary Information - do not edit==\n";
     static constexpr std::string_view HEADER_SUFFIX = "====\n\n";
     static constexpr std::string_view SIGNATURE_PREFIX = "signature = ";
     static constexpr std::string_view VARS_PREFIX = "\nlocal_vars = { ";
     static constexpr std::string_view VARS_SUFFIX = " }\n";
-    std::stringstream stream(std::stringstream::out);
-
-    auto binary_header{header.GetHeader()};
-
-    stream << HEADER_PREFIX;
-    stream << SIGNATURE_PREFIX;
-    stream.write((char*)binary_header.signature, sizeof(binary_header.signature));
-
-    stream << VARS_PREFIX;
-    stream << std::hex << binary_header.local_integer_1;
-    stream << ' ';
-    stream << std::hex << binary_header.local_floats;
-    stream << ' ';
-    stream << std::hex << binary_header.local_strings_1;
-    stream << ' ';
-    stream << std::hex << binary_header.local_integer_2;
-    stream << ' ';
-    stream << std::hex << binary_header.unknown_data;
-    stream << ' ';
-    stream << std::hex << binary_header.local_strings_2;
-    stream << VARS_SUFFIX;
-
-    stream << HEADER_SUFFIX;
-    stream.flush();
-
-    return stream.str();
+
+    auto& binary_header{header.GetHeader()};
+
+    output.append(HEADER_PREFIX);
+    output.append(SIGNATURE_PREFIX);
+    output.append_bytes(binary_header.signature, sizeof(binary_header.signature));
+
+    output.append(VARS_PREFIX);
+    output.append_hex(binary_header.local_integer_1);
+    output.append(' ');
+    output.append_hex(binary_header.local_floats);
+    output.append(' ');
+    output.append_hex(binary_header.local_strings_1);
+    output.append(' ');
+    output.append_hex(binary_header.local_integer_2);
+    output.append(' ');
+    output.append_hex(binary_header.unknown_data);
+    output.append(' ');
+    output.append_hex(binary_header.local_strings_2);
+    output.append(VARS_SUFFIX);
+
+    output.append(HEADER_SUFFIX);
 }
 
-const std::string get_type_label(u32 type) {
+constexpr std::string_view get_type_label(u32 type) {
     switch (type) {
     case 0:   return "";
         // Not the best way to handle floats, but will do for now.
@@ -146,80 +119,80 @@ const std::string get_type_label(u32 type) {
     case 0x800B: return "0x800B";
 
     default: {
-        fprintf(stderr, "Unknown type value: %x\n", type);
-        exit(-1);
+        fail("Unknown type value: %x", type);
     }
     }
 }
 
-std::string disassemble_instruction(Header& header, const Instruction& instruction) {
-    std::stringstream stream(std::stringstream::out);
-
+void disassemble_instruction(Header& header, const Script& script, const Instruction& instruction, Output_Buffer& output) {
     // Give the loc of where we are
     //----------------
-    // stream << std::hex << (instruction->offset << 2) + HEADER_LENGTH << " (" << std::hex << (instruction->offset << 2) << ":" << std::hex << instruction->offset << "): ";
+    // output.append_hex((instruction.offset << 2) + header.GetLength()); output.append(": ");
     //----------------
 
-    stream << instruction.definition->label;
-    if (instruction.arguments.size() > 0) {
-        stream << ' ';
+    const auto arguments{script.arguments_of(instruction)};
+
+    output.append(instruction.definition->label);
+    if (arguments.size() > 0) {
+        output.append(' ');
     }
 
     s32 x = 0;
-    for (const auto& argument : instruction.arguments) {
-        std::string type_label = get_type_label(argument.type);
-        if (type_label != "") {
+    for (const auto& argument : arguments) {
+        const std::string_view type_label = get_type_label(argument.type);
+        if (!type_label.empty()) {
             // e.g. (global_int 17A)
-            stream << '(';
-            stream << type_label << ' ' << std::hex << argument.raw_data;
-            stream << ')';
+            output.append('(');
+            output.append(type_label);
+            output.append(' ');
+            output.append_hex(argument.raw_data);
+            output.append(')');
         } else if (argument.type == 2) {
             // e.g. "this is a string"
-            stream << '"';
-            stream << argument.decoded_stringv4;
-            stream << '"';
+            output.append('"');
+            output.append(script.string(argument.raw_data));
+            output.append('"');
         } else if (instruction.definition->op_code == 0x64 && argument.type == 0) {
             // e.g. [1 2 3 4 5 6]
-            stream << "[";
-            for (u32 i = 0; i < argument.data_array.length; i++) {
-                stream << std::hex << argument.data_array.data[i];
-                if (i < argument.data_array.length - 1) {
-                    stream << ' ';
+            // only the second argument refers to an actual array, the first one is always empty
+            const auto elements{x == 1 ? script.array(argument.raw_data) : std::span<const u32>{}};
+            output.append('[');
+            for (size_t i = 0; i < elements.size(); i++) {
+                output.append_hex(elements[i]);
+                if (i < elements.size() - 1) {
+                    output.append(' ');
                 }
             }
-            stream << "]";
+            output.append(']');
         } else if (is_control_flow(instruction)) {
             // e.g. label_99C8
-            if (is_label_argument(instruction, x)) {
-                stream << "label_";
-                stream << std::right << std::setfill('0') << std::setw(8) << 
-                    std::hex << header.GetLength() + (static_cast<uint64_t>(argument.raw_data) << 2);
+            if (is_label_argument(instruction.definition, x, argument)) {
+                output.append("label_");
+                output.append_hex(header.GetLength() + (static_cast<uint64_t>(argument.raw_data) << 2), 8);
             } else {
-                stream << std::hex << argument.raw_data;
+                output.append_hex(argument.raw_data);
             }
         } else {
-            stream << std::hex << argument.raw_data;
+            output.append_hex(argument.raw_data);
         }
-        if (x < instruction.arguments.size() - 1) {
-            stream << ' ';
+        if (x < arguments.size() - 1) {
+            output.append(' ');
         }
         x++;
     }
 
-    stream << '\n';
-
-    stream.flush();
-    return stream.str();
+    output.append('\n');
 }
 
-std::stringstream write_script_file(Header& header, std::span<Instruction> instructions) {
+void write_script_file(Header& header, const Script& script, Output_Buffer& output, Script_Stats* stats) {
     // Find out which of our instructions are labels
-    std::unordered_set<u32> labels;
-    for (auto& instruction : instructions) {
+    Phase_Timer label_timer(stats, Stats_Phase::Label_Scan);
+    std::pmr::unordered_set<u32> labels{script.resource()};
+    for (const auto& instruction : script.instructions) {
         if (is_control_flow(instruction)) {
             s32 x{0};
-            for (auto& argument : instruction.arguments) {
-                if (is_label_argument(instruction, x)) {
+            for (const auto& argument : script.arguments_of(instruction)) {
+                if (is_label_argument(instruction.definition, x, argument)) {
                     labels.insert(argument.raw_data);
                 }
                 x++;
@@ -227,52 +200,123 @@ std::stringstream write_script_file(Header& header, std::span<Instruction> instr
         }
     }
 
-    std::stringstream output(std::stringstream::in | std::stringstream::out | std::stringstream::binary);
+    label_timer.stop();
+    if (stats) {
+        stats->labels += labels.size();
+    }
 
-    output << disassemble_header(header);
+    Phase_Timer format_timer(stats, Stats_Phase::Format);
+    disassemble_header(header, output);
 
-    for (auto& instruction : instructions) {
+    for (const auto& instruction : script.instructions) {
         // If this instruction is referenced as a label, make it clear
         if (labels.find(instruction.offset) != labels.end()) {
-            std::stringstream label_instr;
-            label_instr << "\nlabel_";
-            label_instr << std::right << std::setfill('0') << std::setw(8) << 
-                std::hex << header.GetLength() + (instruction.offset << 2);
-            label_instr << '\n';
-            output << std::move(label_instr.str());
+            output.append("\nlabel_");
+            output.append_hex(header.GetLength() + (static_cast<u64>(instruction.offset) << 2), 8);
+            output.append('\n');
         }
 
-        output << disassemble_instruction(header, instruction);
+        disassemble_instruction(header, script, instruction, output);
     }
-
-    output.flush();
-    return output;
 }
 
-std::stringstream disassemble(std::istream& fd) {
-    Header header(fd);
-
+void parse_script(std::span<const std::byte> data, Header& header, Script& script, Parse_Mode mode, Script_Stats* stats) {
     auto& binary_hdr{header.GetHeader()};
 
     std::streamoff data_array_end = header.GetLength() + (static_cast<uint64_t>(std::min(std::min(binary_hdr.table_1_offset, binary_hdr.table_2_offset), binary_hdr.table_3_offset)) << 2);
     std::streamoff strings_end = data_array_end;
 
-    std::vector<Instruction> instructions;
-    instructions.reserve(5'000);
+    script.clear();
+    script.instructions.reserve(5'000);
+    script.arguments.reserve(20'000);
+
+    const u64 transcode_before = stats ? stats->time(Stats_Phase::Transcode) : 0;
+    Phase_Timer timer(stats, Stats_Phase::Decode);
 
-    while (fd.tellg() < data_array_end) {
-        std::streamoff offset = fd.tellg();
-        u32 op_code{};
-        fd.read((char*)&op_code, sizeof(op_code));
+    size_t cursor = header.GetLength();
+    while (static_cast<std::streamoff>(cursor) < data_array_end) {
+        std::streamoff offset = cursor;
+        u32 op_code = read_value<u32>(data, cursor);
+        cursor += sizeof(op_code);
 
         if (op_code == 0x0) {
-            fprintf(stderr, "Offset 0x%llX bad opcode : %X\n", offset, op_code);
-            exit(-1);
+            fail("Offset 0x%llX bad opcode : %X", static_cast<long long>(offset), op_code);
         }
 
         const Instruction_Definition* def = instruction_for_op_code(op_code, offset);
-        instructions.emplace_back(parse_instruction(fd, header, def, (offset - header.GetLength()) >> 2, &data_array_end));
+        if (data.size() - offset < op_code_info(op_code).length) {
+            fail("Offset 0x%llX truncated instruction : %X", static_cast<long long>(offset), op_code);
+        }
+
+        parse_instruction(data, cursor, header, def, static_cast<u32>((offset - header.GetLength()) >> 2), &data_array_end, script, mode, stats);
+    }
+
+    timer.stop();
+    if (stats) {
+        // The strings were timed on their own
+        stats->time(Stats_Phase::Decode) -= stats->time(Stats_Phase::Transcode) - transcode_before;
     }
+}
+
+Result disassemble(std::span<const std::byte> data, Output_Buffer& output, std::pmr::memory_resource* scratch, Script_Stats* stats) {
+    const size_t start = output.size();
+    Result result = capture_errors([&] {
+        Phase_Timer header_timer(stats, Stats_Phase::Header);
+        Header header(data);
+        header_timer.stop();
 
-    return write_script_file(header, instructions);
-}
\ No newline at end of file
+        Script script{scratch};
+        parse_script(data, header, script, Parse_Mode::Full, stats);
+
+        write_script_file(header, script, output, stats);
+
+        if (stats) {
+            stats->bytes_in += data.size();
+            stats->bytes_out += output.size() - start;
+            stats->instructions += script.instructions.size();
+            stats->strings += script.string_offsets.size();
+            stats->arrays += script.array_offsets.size();
+        }
+    });
+    if (!result) {
+        output.truncate(start);
+    }
+    return result;
+}
+
+std::string describe_offset(std::span<const std::byte> data, size_t offset) try {
+    Header header(data);
+    if (offset < header.GetLength()) {
+        return "header";
+    }
+
+    Script script;
+    parse_script(data, header, script, Parse_Mode::Full);
+    const auto& instructions{script.instructions};
+
+    // Instruction offsets are in words past the header, find the last one starting at or before our byte
+    const u64 word = (offset - header.GetLength()) >> 2;
+    auto it = std::ranges::upper_bound(instructions, word, {}, [](const Instruction& instruction) { return static_cast<u64>(instruction.offset); });
+    if (it == instructions.begin()) {
+        return "header";
+    }
+    const Instruction& instruction = *std::prev(it);
+
+    // Past the end of the last instruction is the string pool, arrays and tables
+    if (word >= static_cast<u64>(instruction.offset) + 1 + 2 * instruction.definition->argument_count) {
+        return "string pool / footer";
+    }
+
+    // e.g. 000099C8 : jump label_0000A0F4
+    Output_Buffer text;
+    text.append_hex(header.GetLength() + (static_cast<u64>(instruction.offset) << 2), 8);
+    text.append(" : ");
+    disassemble_instruction(header, script, instruction, text);
+    std::string description{text.view()};
+    while (!description.empty() && (description.back() == '\n' || description.back() == '\r')) {
+        description.pop_back();
+    }
+    return description;
+} catch (const Age_Error& error) {
+    return error.what();
+}
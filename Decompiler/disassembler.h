@@ -1,3 +1,30 @@
 #pragma once
+#include <span>
+#include <string>
 
-std::stringstream disassemble(std::istream& fd);
\ No newline at end of file
+#include "age-error.h"
+#include "age-shared.h"
+#include "output-buffer.h"
+#include "script-stats.h"
+
+// How much of a script parse_script resolves
+enum class Parse_Mode {
+    Full,   // strings decoded to UTF8 and arrays copied into the script's side tables
+    Layout, // only the instruction stream : string and array arguments keep their raw file offsets
+};
+
+// Reads the instruction stream of a script image, replacing the contents of script. Throws an Age_Error on corrupted data.
+void parse_script(std::span<const std::byte> data, Header& header, Script& script, Parse_Mode mode, Script_Stats* stats = nullptr);
+
+// Appends the text form of one parsed instruction, e.g. jmp label_000099C8
+void disassemble_instruction(Header& header, const Script& script, const Instruction& instruction, Output_Buffer& output);
+
+// Appends the text form of a script image to output. Safe to call from any number of threads at once.
+// All the per-file containers are allocated from scratch, e.g. a worker's Scratch_Arena.
+// On failure nothing is appended and the Result says what was wrong with the script.
+// Counters and phase times are added to stats when there is one.
+Result disassemble(std::span<const std::byte> data, Output_Buffer& output, std::pmr::memory_resource* scratch = std::pmr::get_default_resource(),
+                   Script_Stats* stats = nullptr);
+
+// Describes what lives at a byte offset of a script : the header, the instruction covering it (with its offset), or the string pool / footer
+std::string describe_offset(std::span<const std::byte> data, size_t offset);
\ No newline at end of file
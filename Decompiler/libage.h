@@ -0,0 +1,15 @@
+#pragma once
+// Everything an embedding program needs : in-memory disassembly / assembly of scripts, string tables and archives.
+// No entry point exits or throws on bad data, scripts report their errors through a Result (see age-error.h).
+// Every function is safe to call from several threads at once, as long as each thread has its own output and scratch.
+
+#include "age-error.h"
+#include "age-shared.h"
+#include "archive.h"
+#include "disassembler.h"
+#include "mapped-file.h"
+#include "output-buffer.h"
+#include "reassembler.h"
+#include "scratch-arena.h"
+#include "script-stats.h"
+#include "string-table.h"
@@ -0,0 +1,134 @@
+#include "lzss.h"
+
+#include <algorithm>
+#include <cstring>
+
+size_t lzss_decompress(std::span<const std::byte> input, size_t max_size, std::vector<std::byte>& output) {
+    const size_t start = output.size();
+    output.resize(start + max_size);
+
+    // The ring buffer is never materialized : ring position p at output position o is (N - F + o) % N,
+    // so a match is a back reference into what we already wrote. Anything before the start of the output is
+    // the zeroed initial ring.
+    u8* const out = reinterpret_cast<u8*>(output.data() + start);
+    const u8* in = reinterpret_cast<const u8*>(input.data());
+    const u8* const in_end = in + input.size();
+    size_t written = 0;
+
+    while (in < in_end && written < max_size) {
+        u32 flags = *in++;
+        for (u32 bit = 0; bit < 8 && in < in_end && written < max_size; bit++, flags >>= 1) {
+            if (flags & 1) {
+                out[written++] = *in++;
+                continue;
+            }
+
+            if (in_end - in < 2) {
+                in = in_end;
+                break;
+            }
+            const size_t position = in[0] | ((in[1] & 0xF0) << 4);
+            const size_t length = std::min<size_t>((in[1] & 0x0F) + LZSS_THRESHOLD + 1, max_size - written);
+            in += 2;
+
+            // Reading the ring slot about to be overwritten means looking a full ring back
+            const size_t ring = (LZSS_RING_SIZE - LZSS_MAX_MATCH + written) & (LZSS_RING_SIZE - 1);
+            const size_t distance = ((ring - position - 1) & (LZSS_RING_SIZE - 1)) + 1;
+
+            if (distance <= written && distance >= length) {
+                // Common case : no overlap, nothing from the initial ring
+                std::memcpy(out + written, out + written - distance, length);
+                written += length;
+            } else {
+                for (size_t i = 0; i < length; i++, written++) {
+                    out[written] = written >= distance ? out[written - distance] : 0;
+                }
+            }
+        }
+    }
+
+    output.resize(start + written);
+    return written;
+}
+
+void lzss_compress(std::span<const std::byte> input, std::vector<std::byte>& output) {
+    constexpr size_t MIN_MATCH = LZSS_THRESHOLD + 1;
+    constexpr size_t WINDOW = LZSS_RING_SIZE - LZSS_MAX_MATCH;
+    constexpr u32 HASH_BITS = 14;
+    constexpr u32 MAX_CHAIN = 256;
+    constexpr u32 NONE = 0xFFFFFFFF;
+
+    const u8* const in = reinterpret_cast<const u8*>(input.data());
+    const size_t size = input.size();
+
+    // head holds the latest position of every 3 byte hash, prev links each position to the previous one with the same hash
+    std::vector<u32> head(size_t{1} << HASH_BITS, NONE);
+    std::vector<u32> prev(LZSS_RING_SIZE, NONE);
+    const auto hash = [&](size_t pos) {
+        return ((in[pos] << 10) ^ (in[pos + 1] << 5) ^ in[pos + 2]) & ((1u << HASH_BITS) - 1);
+    };
+    const auto insert = [&](size_t pos) {
+        if (size - pos < MIN_MATCH) return;
+        const u32 h = hash(pos);
+        prev[pos & (LZSS_RING_SIZE - 1)] = head[h];
+        head[h] = static_cast<u32>(pos);
+    };
+
+    size_t flag_position = 0;
+    u32 flag_bit = 8;
+    const auto begin_item = [&] {
+        if (flag_bit == 8) {
+            flag_position = output.size();
+            output.push_back(std::byte{0});
+            flag_bit = 0;
+        }
+    };
+
+    size_t pos = 0;
+    while (pos < size) {
+        size_t best_length = 0;
+        size_t best_distance = 0;
+
+        if (size - pos >= MIN_MATCH) {
+            const size_t max_length = std::min(LZSS_MAX_MATCH, size - pos);
+            u32 candidate = head[hash(pos)];
+            for (u32 chain = 0; candidate != NONE && chain < MAX_CHAIN; chain++) {
+                const size_t distance = pos - candidate;
+                if (distance > WINDOW) break;
+
+                size_t length = 0;
+                while (length < max_length && in[candidate + length] == in[pos + length]) {
+                    length++;
+                }
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = distance;
+                    if (length == max_length) break;
+                }
+
+                const u32 next = prev[candidate & (LZSS_RING_SIZE - 1)];
+                // The slot may have been reused by a newer position, which ends this chain
+                if (next == NONE || next >= candidate) break;
+                candidate = next;
+            }
+        }
+
+        begin_item();
+        if (best_length >= MIN_MATCH) {
+            // Ring position of the match start, the ring cursor started at N - F
+            const size_t ring = (LZSS_RING_SIZE - LZSS_MAX_MATCH + pos - best_distance) & (LZSS_RING_SIZE - 1);
+            output.push_back(static_cast<std::byte>(ring & 0xFF));
+            output.push_back(static_cast<std::byte>(((ring >> 4) & 0xF0) | (best_length - MIN_MATCH)));
+            for (size_t i = 0; i < best_length; i++) {
+                insert(pos + i);
+            }
+            pos += best_length;
+        } else {
+            output[flag_position] |= static_cast<std::byte>(1 << flag_bit);
+            output.push_back(static_cast<std::byte>(in[pos]));
+            insert(pos);
+            pos++;
+        }
+        flag_bit++;
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <span>
+#include <vector>
+
+#include "types.h"
+
+// LZSS as used by the compressed archive indexes (S5IC / S5AC) : the classic Okumura variant.
+// 4KB ring buffer starting zeroed with its cursor at N - F, flag bytes read LSB first where a set bit is a literal,
+// and matches of 3 to 18 bytes encoded as 12 bits of ring position and 4 bits of length.
+inline constexpr size_t LZSS_RING_SIZE = 4096;
+inline constexpr size_t LZSS_MAX_MATCH = 18;
+inline constexpr size_t LZSS_THRESHOLD = 2;
+
+// Decodes input, appending at most max_size bytes to output. Returns the amount of bytes decoded.
+size_t lzss_decompress(std::span<const std::byte> input, size_t max_size, std::vector<std::byte>& output);
+
+// Encodes input, appending to output. Greedy longest match search over hash chains, matches never reach further back
+// than N - F so any decoder of the original scheme reads them back correctly.
+void lzss_compress(std::span<const std::byte> input, std::vector<std::byte>& output);
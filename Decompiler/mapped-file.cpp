@@ -0,0 +1,93 @@
+#include "mapped-file.h"
+
+#ifdef _WIN32
+#include "Windows.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+Mapped_File::Mapped_File(const std::filesystem::path& path) {
+    m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        m_file = nullptr;
+        return;
+    }
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(m_file, &size)) {
+        return;
+    }
+
+    m_size = static_cast<size_t>(size.QuadPart);
+    m_open = true;
+
+    // Windows refuses to map empty files, an empty view is all we need there
+    if (m_size == 0) {
+        return;
+    }
+
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping == nullptr) {
+        m_open = false;
+        return;
+    }
+
+    m_data = static_cast<const std::byte*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr) {
+        m_open = false;
+    }
+}
+
+Mapped_File::~Mapped_File() {
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file) {
+        CloseHandle(m_file);
+    }
+}
+#else
+Mapped_File::Mapped_File(const std::filesystem::path& path) {
+    m_fd = open(path.c_str(), O_RDONLY);
+    if (m_fd < 0) {
+        return;
+    }
+
+    struct stat st{};
+    if (fstat(m_fd, &st) != 0) {
+        return;
+    }
+
+    m_size = static_cast<size_t>(st.st_size);
+    m_open = true;
+
+    if (m_size == 0) {
+        return;
+    }
+
+    void* view = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (view == MAP_FAILED) {
+        m_open = false;
+        return;
+    }
+
+    madvise(view, m_size, MADV_WILLNEED);
+    m_data = static_cast<const std::byte*>(view);
+}
+
+Mapped_File::~Mapped_File() {
+    if (m_data) {
+        munmap(const_cast<std::byte*>(m_data), m_size);
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+#endif
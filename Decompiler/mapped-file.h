@@ -0,0 +1,33 @@
+#pragma once
+#include <filesystem>
+#include <span>
+
+#include "types.h"
+
+// Read-only memory mapping of a whole file. The view stays valid for the lifetime of the object.
+struct Mapped_File {
+    explicit Mapped_File(const std::filesystem::path& path);
+    ~Mapped_File();
+
+    Mapped_File(const Mapped_File&) = delete;
+    Mapped_File& operator=(const Mapped_File&) = delete;
+
+    bool is_open() const {
+        return m_open;
+    }
+
+    std::span<const std::byte> data() const {
+        return {m_data, m_size};
+    }
+
+private:
+    const std::byte* m_data{};
+    size_t m_size{};
+    bool m_open{};
+#ifdef _WIN32
+    void* m_file{};
+    void* m_mapping{};
+#else
+    int m_fd{-1};
+#endif
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "types.h"
+
+// Growable output buffer for a whole file. Appending never allocates once the buffer has grown to size,
+// so one buffer can be cleared and reused for every file a worker handles.
+class Output_Buffer {
+public:
+    void clear() {
+        m_size = 0;
+    }
+
+    void reserve(size_t size) {
+        if (size > m_storage.size()) {
+            m_storage.resize(size);
+        }
+    }
+
+    const char* data() const {
+        return m_storage.data();
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    std::string_view view() const {
+        return {m_storage.data(), m_size};
+    }
+
+    // Drops everything past size, e.g. a file which failed half way through
+    void truncate(size_t size) {
+        m_size = std::min(m_size, size);
+    }
+
+    // Grows the buffer by count bytes and returns where they start, for callers that fill them in directly
+    char* extend(size_t count) {
+        return grow(count);
+    }
+
+    void append(char c) {
+        *grow(1) = c;
+    }
+
+    void append(std::string_view text) {
+        std::memcpy(grow(text.size()), text.data(), text.size());
+    }
+
+    void append_bytes(const void* bytes, size_t size) {
+        std::memcpy(grow(size), bytes, size);
+    }
+
+    // Lower case hex without leading zeros, like std::hex
+    void append_hex(u64 value) {
+        char digits[16];
+        const auto result = std::to_chars(digits, digits + sizeof(digits), value, 16);
+        append(std::string_view{digits, static_cast<size_t>(result.ptr - digits)});
+    }
+
+    // Lower case hex, zero padded to at least width digits, like std::setfill('0') << std::setw(width)
+    void append_hex(u64 value, size_t width) {
+        char digits[16];
+        const auto result = std::to_chars(digits, digits + sizeof(digits), value, 16);
+        const size_t length = result.ptr - digits;
+        if (length < width) {
+            std::memset(grow(width - length), '0', width - length);
+        }
+        append(std::string_view{digits, length});
+    }
+
+private:
+    char* grow(size_t count) {
+        if (m_storage.size() - m_size < count) {
+            m_storage.resize(std::max(m_storage.size() * 2, m_size + count));
+        }
+        char* position = m_storage.data() + m_size;
+        m_size += count;
+        return position;
+    }
+
+    std::vector<char> m_storage;
+    size_t m_size{};
+};
@@ -0,0 +1,86 @@
+#include "perf-counters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+std::string_view Perf_Counters::name(Counter counter) {
+    static constexpr std::array<std::string_view, COUNTER_COUNT> names{"cycles", "instructions", "cache_misses", "branch_misses"};
+    return names[counter];
+}
+
+#ifdef __linux__
+Perf_Counters::Perf_Counters() {
+    static constexpr std::array<u64, COUNTER_COUNT> configs{
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+
+    m_fds.fill(-1);
+    m_available = true;
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.config = configs[i];
+        attributes.disabled = 1;
+        attributes.inherit = 1; // worker threads too
+        // User space only, which unprivileged processes are allowed to count by default
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+
+        m_fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+        if (m_fds[i] < 0) {
+            m_available = false;
+        }
+    }
+}
+
+Perf_Counters::~Perf_Counters() {
+    for (const int fd : m_fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+void Perf_Counters::start() {
+    if (!m_available) return;
+    for (const int fd : m_fds) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+Perf_Counters::Counts Perf_Counters::stop() {
+    Counts counts{};
+    if (!m_available) return counts;
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        ioctl(m_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(m_fds[i], &counts[i], sizeof(counts[i])) != sizeof(counts[i])) {
+            counts[i] = 0;
+        }
+    }
+    return counts;
+}
+#else
+Perf_Counters::Perf_Counters() {
+    m_fds.fill(-1);
+}
+
+Perf_Counters::~Perf_Counters() = default;
+
+void Perf_Counters::start() {}
+
+Perf_Counters::Counts Perf_Counters::stop() {
+    return {};
+}
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+#include <array>
+#include <string_view>
+
+#include "types.h"
+
+// Hardware counters for the whole process, through perf_event_open on Linux.
+// Threads are only counted if they were started after the counters were opened, and their counts only show up once they exit :
+// open the counters, create the thread pool, run, destroy the pool and then stop().
+// Elsewhere, or when the kernel refuses (perf_event_paranoid, containers), available() is false and every count reads 0.
+class Perf_Counters {
+public:
+    enum Counter {
+        Cycles,
+        Instructions,
+        Cache_Misses,
+        Branch_Misses,
+        COUNTER_COUNT,
+    };
+    using Counts = std::array<u64, COUNTER_COUNT>;
+
+    Perf_Counters();
+    ~Perf_Counters();
+
+    Perf_Counters(const Perf_Counters&) = delete;
+    Perf_Counters& operator=(const Perf_Counters&) = delete;
+
+    bool available() const {
+        return m_available;
+    }
+
+    // Resets and enables every counter
+    void start();
+    // Disables every counter and reads them
+    Counts stop();
+
+    // e.g. cache_misses, as used in the JSON results
+    static std::string_view name(Counter counter);
+
+private:
+    std::array<int, COUNTER_COUNT> m_fds;
+    bool m_available{};
+};
@@ -1,5 +1,9 @@
 #include "age-shared.h"
 #include "reassembler.h"
+#include "script-lexer.h"
+#include "string-pool.h"
+
+#include <algorithm>
 
 /*
 template<typename T>
@@ -18,21 +22,7 @@ static std::vector<size_t> average;
     std::cout << "array_arguments " << max_val << " " << "curr avg: " << avg << '\n';
 */
 
-static const std::regex re_parse_instr("(^[\\w\\-_]+) ?|(label_[0-9a-fA-F]+)");
-static const std::regex re_parse_args("\\((\\w+?\\-?\\w+?\\-?\\w+?) ([0-9a-fA-F]+)\\)|(\\\".*?\\\")|label_([0-9a-fA-F]+)|\\[(.+?)\\]|([0-9a-fA-F]+)");
-static const std::regex re_local_vars("([0-9a-fA-F]+?) ");
-
-enum ARGUMENT_TYPE {
-    REG_TYPE = 0,
-    REG_NUM,
-    STR,
-    LABEL,
-    ARRAY,
-    VALUE,
-    TOTAL
-};
-
-u32 get_type(const std::string name) {
+u32 get_type(std::string_view name) {
     // most frequent, by far, is local-int
     if (name == "local-int")          return 9;
     else if (name == "local-ptr")          return 0xC;
@@ -53,97 +43,109 @@ u32 get_type(const std::string name) {
     else if (name == "unknown0x8009")      return 0x8009;
     else if (name == "unknown0x800B")      return 0x800B;
 
-    fprintf(stdout, "Unknown variable type: %s\n", name.c_str());
-    exit(-2);
-}
-
-auto parse_multiple_arguments(std::string line, const std::regex& regex) {
-    std::vector<std::vector<std::string>> elements;
-    elements.reserve(ARGUMENT_TYPE::TOTAL);
-    std::match_results<std::string::const_iterator> matches;
-
-    while (std::regex_search(line, matches, regex)) {
-        std::vector<std::string> sub_elements;
-        sub_elements.reserve(matches.size() - 1);
-        for (u32 i{1}; i < matches.size(); ++i) {
-            sub_elements.push_back(std::move(matches.str(i)));
-        }
-        elements.push_back(std::move(sub_elements));
-        line = std::move(matches.suffix().str());
-    }
-
-    return elements;
+    fail("Unknown variable type: %.*s", (int)name.size(), name.data());
 }
 
-Header parse_header(std::istream& fd) {
+Header parse_header(Script_Lexer& lexer) {
     // All we are interested in are the signature and local_vars
-    BinaryHeader binary_header;
-    std::string line;
+    BinaryHeader binary_header{};
 
-    std::getline(fd, line); // ==Binary Information - do not edit==
+    lexer.read_line(); // ==Binary Information - do not edit==
 
-    std::getline(fd, line); // Signature = SYSxxxx
-    std::memcpy(binary_header.signature, line.substr(line.find("= ") + 2, line.length()).data(), sizeof(binary_header.signature));
+    std::string_view line = lexer.read_line(); // Signature = SYSxxxx
+    const size_t sig_start = line.find("= ");
+    if (sig_start != std::string_view::npos) {
+        line.remove_prefix(sig_start + 2);
+        std::memcpy(binary_header.signature, line.data(), std::min(line.size(), sizeof(binary_header.signature)));
+    }
+
+    line = lexer.read_line(); // local_vars = { }
+    std::array<u32, 6> local_vars{};
+    u32 local_var_count = 0;
 
-    std::getline(fd, line); // local_vars = { }
-    const auto local_vars{ parse_multiple_arguments(line, re_local_vars) };
+    // Local vars are in hex string form, separated by a whitespace
+    const size_t vars_start = line.find('{');
+    line.remove_prefix(vars_start == std::string_view::npos ? line.size() : vars_start + 1);
+    while (!line.empty() && local_var_count < local_vars.size()) {
+        const size_t start = line.find_first_not_of(' ');
+        if (start == std::string_view::npos) break;
+        line.remove_prefix(start);
+        const std::string_view value = line.substr(0, line.find(' '));
+        if (!parse_hex(value, local_vars[local_var_count])) break;
+        local_var_count++;
+        line.remove_prefix(value.size());
+    }
 
-    if (local_vars.size() < 6) {
-        fprintf(stdout, "Header is corrupted, there should be 6 local_vars, but could only read %d\n", (u32)local_vars.size());
-        _exit(-1);
+    if (local_var_count < 6) {
+        fail("Header is corrupted, there should be 6 local_vars, but could only read %d", local_var_count);
     }
 
     binary_header.sub_header_length = 0x1C; // can this be anything else?
 
-    // Local vars are in hex string form, separated by a whitespace
-    binary_header.local_integer_1 = std::stoul(local_vars[0][0], nullptr, 16);
-    binary_header.local_floats = std::stoul(local_vars[1][0], nullptr, 16);
-    binary_header.local_strings_1 = std::stoul(local_vars[2][0], nullptr, 16);
-    binary_header.local_integer_2 = std::stoul(local_vars[3][0], nullptr, 16);
-    binary_header.unknown_data = std::stoul(local_vars[4][0], nullptr, 16);
-    binary_header.local_strings_2 = std::stoul(local_vars[5][0], nullptr, 16);
+    binary_header.local_integer_1 = local_vars[0];
+    binary_header.local_floats = local_vars[1];
+    binary_header.local_strings_1 = local_vars[2];
+    binary_header.local_integer_2 = local_vars[3];
+    binary_header.unknown_data = local_vars[4];
+    binary_header.local_strings_2 = local_vars[5];
 
-    std::getline(fd, line); // ====
+    lexer.read_line(); // ====
 
-    // We have now read all of our header, and positioned the file handle at the start of our instruction list
+    // We have now read all of our header, and positioned the lexer at the start of our instruction list
     return std::move(binary_header);
 }
 
-inline constexpr size_t compute_length(Instruction_Definition definition) {
-    // op_code (4 bytes) + 2 * (4 bytes) * (argument_count)
-    return 4 + (static_cast<size_t>(definition.argument_count) << 3);
+template <typename T>
+static inline char* put(char* out, const T& value) {
+    std::memcpy(out, &value, sizeof(value));
+    return out + sizeof(value);
 }
 
-std::stringstream write_assembled_file(Header& header, std::span<Instruction> instructions, std::string_view string_data, std::span<u32> footer_data) {
-    std::stringstream output(std::stringstream::in | std::stringstream::out | std::stringstream::binary);
+void write_assembled_file(Header& header, const Script& script, u32 instructions_end, std::span<const u32> footer_data, Output_Buffer& output) {
     auto& binary_header{header.GetHeader()};
 
+    // Every part of the file has a known size by now : header and instructions up to instructions_end, then the string pool and the footer.
+    // Grow the output once and fill it in place.
+    const std::string_view string_data{script.string_data};
+    const size_t file_size = instructions_end + string_data.size() + footer_data.size_bytes();
+    output.reserve(output.size() + file_size);
+    char* const start = output.extend(file_size);
+    char* out = start;
+
     if (header.IsVer5()) {
-        std::string utf8_sig{binary_header.signature};
-        utf8_sig[utf8_sig.size() - 1] = '\0';
-        auto u16_sig{cp_to_utf16(CP_UTF8, utf8_sig)};
-        output.write((char*)u16_sig.data(), 16);
-        output.write((char*)&binary_header.local_integer_1, sizeof(binary_header) - sizeof(binary_header.signature));
+        // The 8 signature characters are stored as UTF16 in version 5
+        for (const char c : binary_header.signature) {
+            out = put(out, static_cast<char16_t>(c));
+        }
+        std::memcpy(out, &binary_header.local_integer_1, sizeof(binary_header) - sizeof(binary_header.signature));
+        out += sizeof(binary_header) - sizeof(binary_header.signature);
     } else {
-        output.write((char*)&binary_header, sizeof(binary_header));
+        out = put(out, binary_header);
     }
 
-    for (const auto& instruction : instructions) {
-        output.write((char*)&instruction.definition->op_code, sizeof(u32));
-        for (const auto& argument : instruction.arguments) {
-            output.write((char*)&argument.type, sizeof(u32));
-            output.write((char*)&argument.raw_data, sizeof(u32));
+    for (const auto& instruction : script.instructions) {
+        out = put(out, instruction.definition->op_code);
+        for (const auto& argument : script.arguments_of(instruction)) {
+            out = put(out, argument.type);
+            out = put(out, argument.raw_data);
         }
     }
 
-    output.write(string_data.data(), string_data.length());
-    output.write((char*)footer_data.data(), footer_data.size() * sizeof(u32));
-    output.flush();
-    return output;
+    std::memcpy(out, string_data.data(), string_data.size());
+    out += string_data.size();
+    std::memcpy(out, footer_data.data(), footer_data.size_bytes());
+    out += footer_data.size_bytes();
+
+    if (static_cast<size_t>(out - start) != file_size) {
+        fail("Assembled size mismatch : expected 0x%zx bytes but wrote 0x%zx", file_size, static_cast<size_t>(out - start));
+    }
 }
 
-std::stringstream assemble(std::istream& fd) {
-    Header header = parse_header(fd);
+static void assemble_script(std::string_view text, Output_Buffer& output, std::pmr::memory_resource* scratch, Script_Stats* stats) {
+    Phase_Timer header_timer(stats, Stats_Phase::Header);
+    Script_Lexer lexer(text);
+    Header header = parse_header(lexer);
+    header_timer.stop();
     auto& binary_header{header.GetHeader()};
     // Note that the header is not fully initialized : some of its information may change and has to be computed again.
     // For now, we need to parse the instruction list.
@@ -152,199 +154,188 @@ std::stringstream assemble(std::istream& fd) {
      * This is using a lot of maps and sets since I am trying to do most of the job at once whilst reading the disassembled file.
      * This might be more readable if I iterated over the reassembled instructions to restore the changed information.
     */
-    std::vector<Instruction> instructions;
-    instructions.reserve(5'000);
+    // Strings are encoded straight into the pool and arrays straight into the footer as they are read,
+    // their arguments hold the side table index until the final offsets are known
+    Script script{scratch};
+    script.instructions.reserve(5'000);
+    script.arguments.reserve(20'000);
+    script.string_data.reserve(5'000);
+    script.array_data.reserve(1'000);
     // We'll have to "remember" the offsets to the 'label' functions...
-    std::unordered_map<u32, u32> label_to_offset;
+    std::pmr::unordered_map<u32, u32> label_to_offset{scratch};
     // ... in order to replace them in the arguments that reference them
-    std::vector<std::pair<size_t, size_t>> label_arguments;
+    std::pmr::vector<u32> label_arguments{scratch};
     label_arguments.reserve(2'000);
     // We also need to record the offsets of these instructions that are part of the sub-header : 0x71, 0x3 and 0x8f
-    std::unordered_set<u32> instr_3_offsets;
-    std::unordered_set<u32> instr_71_offsets;
-    std::unordered_set<u32> instr_8f_offsets;
+    std::pmr::unordered_set<u32> instr_3_offsets{scratch};
+    std::pmr::unordered_set<u32> instr_71_offsets{scratch};
+    std::pmr::unordered_set<u32> instr_8f_offsets{scratch};
     // we'll have to replace the string arguments with their offset in the assembled file
-    std::vector<std::pair<size_t, size_t>> string_arguments;
+    std::pmr::vector<u32> string_arguments{scratch};
     string_arguments.reserve(200);
     // Finally, we'll have to replace the arrays with their offset in the footer of the assembled file
-    std::vector<std::pair<size_t, size_t>> array_arguments;
+    std::pmr::vector<u32> array_arguments{scratch};
     array_arguments.reserve(100);
+    // Reused for every string's conversion
+    std::pmr::string cp932_scratch{scratch};
+    std::pmr::u16string utf16_scratch{scratch};
 
     u32 data_array_end = header.GetLength();
 
-    std::string line;
-    u32 line_count = 6;
-    while (!fd.eof()) {
-        std::getline(fd, line);
-
-        // Skip empty lines
-        if (line == "") continue;
-        // Skip lines starting with // for single-line comments
-        else if (line.starts_with("//")) continue;
-        // Skip multi-line comment, cut out everything up to the ending */
-        else if (line.starts_with("/*")) {
-            while (!fd.eof() && line.find("*/") == std::string::npos)
-                std::getline(fd, line);
-            if (fd.eof()) break;
-            line = line.substr(line.find("*/") + 2, line.length());
-        }
+    const u64 string_pool_before = stats ? stats->time(Stats_Phase::String_Pool) : 0;
+    Phase_Timer lex_timer(stats, Stats_Phase::Lex);
+    for (Token token = lexer.next(); token.type != Token_Type::End; token = lexer.next()) {
+        const u32 line_count = lexer.line();
 
-        const auto matches{parse_multiple_arguments(line, re_parse_instr)};
-        if (matches.size() == 0) {
-            fprintf(stderr, "Failed to parse line %d.\n", line_count);
-            exit(-1);
+        if (token.type == Token_Type::Label) {
+            label_to_offset[token.value] = data_array_end;
+            if (lexer.next().type != Token_Type::Newline) {
+                fail("Unexpected data after label on line %d.", line_count);
+            }
+            continue;
         }
-        std::string instruction{matches[0][0]};
 
-        if (instruction.starts_with("label_")) {
-            label_to_offset[std::stoul(instruction.substr(6), nullptr, 16)] = data_array_end;
-            continue;
+        if (token.type != Token_Type::Identifier) {
+            fail("Failed to parse line %d.", line_count);
         }
 
+        const std::string_view instruction{token.text};
         const Instruction_Definition* definition = instruction_for_label(instruction);
 
-        Instruction& new_instruction = instructions.emplace_back(definition, data_array_end);
-
-        if (definition->argument_count > 0) {
-            auto str_arguments{ parse_multiple_arguments(line.substr(instruction.length() + 1, line.length()), re_parse_args) };
+        script.instructions.push_back({definition, static_cast<u32>(script.arguments.size()), (data_array_end - header.GetLength()) >> 2});
 
-            if (definition->argument_count != str_arguments.size()) {
-                fprintf(stderr, "Argument mismatch for %s on line %d.\n", instruction.c_str(), line_count);
-                fprintf(stderr, "Expected %d args but found %d.\n", definition->argument_count, (u32)str_arguments.size());
-                exit(-1);
+        // read in the arguments of this function
+        u32 argument_count = 0;
+        for (Token arg = lexer.next(); arg.type != Token_Type::Newline; arg = lexer.next(), argument_count++) {
+            // Keep counting past the expected amount so the error below can report it
+            if (argument_count >= definition->argument_count) {
+                continue;
             }
 
-            // read in the arguments of this function
-            for (auto& arg : str_arguments) {
-                Argument& current = new_instruction.arguments.emplace_back();
-                std::pair<size_t, size_t> current_index{instructions.size() - 1, new_instruction.arguments.size() - 1};
-
-                // str_arguments is a 2D vector of argument and argument info
-                // str_arguments[x][REG_TYPE] contains scope and type          (e.g. the "global-int" in "global-int 7")
-                // str_arguments[x][REG_NUM]  contains value when above is set (e.g. the 7 in "global-int 7")
-                // str_arguments[x][STR]      contains string literals, e.g text lines
-                // str_arguments[x][LABEL]    contains labels
-                // str_arguments[x][VALUE]    contains number literals
-
-                if (!arg[ARGUMENT_TYPE::REG_TYPE].empty()) {
-                    current.type = get_type(arg[ARGUMENT_TYPE::REG_TYPE]);
-                    current.raw_data = std::stoul(arg[ARGUMENT_TYPE::REG_NUM], nullptr, 16);
-                } else if (!arg[ARGUMENT_TYPE::STR].empty()) {
-                    // Strip the quotes
-                    arg[ARGUMENT_TYPE::STR] = arg[ARGUMENT_TYPE::STR].substr(1, arg[ARGUMENT_TYPE::STR].length() - 2);
-
-                    // We'll have to "restore" this argument's data later on as the offset where the string will be written
-                    current.type = 2;
-
-                    if (header.IsVer5()) {
-                        // Convert back to UTF16
-                        current.decoded_stringv5 = cp_to_utf16(CP_UTF8, arg[ARGUMENT_TYPE::STR]);
-                    } else {
-                        // Convert back to CP932
-                        current.decoded_stringv4 = utf16_to_cp(CP_932, cp_to_utf16(CP_UTF8, arg[ARGUMENT_TYPE::STR]));
-                    }
+            const u32 current_index = static_cast<u32>(script.arguments.size());
+            Argument& current = script.arguments.emplace_back();
+
+            switch (arg.type) {
+            case Token_Type::Register:
+                // e.g. (global-int 7)
+                current.type = get_type(arg.text);
+                current.raw_data = arg.value;
+                break;
+            case Token_Type::String: {
+                Phase_Timer timer(stats, Stats_Phase::String_Pool);
+                // We'll have to "restore" this argument's data later on as the offset where the string will be written
+                current.type = 2;
+                current.raw_data = static_cast<u32>(script.string_offsets.size());
+                script.string_offsets.push_back(static_cast<u32>(script.string_data.size()));
+
+                // we have at least one 0xFF as a separator, + as many as needed to reach a multiple of four for the next offset.
+                if (header.IsVer5()) {
+                    // Convert back to UTF16
+                    utf16_scratch.clear();
+                    utf8_to_utf16(arg.text, utf16_scratch);
+                    encode_pool_string(utf16_scratch, script.string_data);
+                } else {
+                    // Convert back to CP932
+                    cp932_scratch.clear();
+                    utf8_to_cp932(arg.text, cp932_scratch);
+                    encode_pool_string(cp932_scratch, script.string_data);
+                }
 
-                    string_arguments.push_back(current_index);
-                } else if (!arg[ARGUMENT_TYPE::LABEL].empty()) {
-                    current.type = 0;
-                    // We don't know -yet- the actual offset of this label
-                    current.raw_data = std::stoul(arg[ARGUMENT_TYPE::LABEL], nullptr, 16);
-                    label_arguments.push_back(current_index);
-                } else if (!arg[ARGUMENT_TYPE::ARRAY].empty()) {
-                    std::vector<u32> data;
-                    data.reserve(4);
-                    s32 start = 0, end = 0;
-                    while (start < arg[ARRAY].length()) {
-                        end = arg[ARGUMENT_TYPE::ARRAY].find_first_of(" ", start);
-                        if (end < 0) end = arg[ARRAY].length();
-                        data.push_back(std::stoul(arg[ARGUMENT_TYPE::ARRAY].substr(start, end), nullptr, 16));
-                        start = end + 1;
+                string_arguments.push_back(current_index);
+                break;
+            }
+            case Token_Type::Label:
+                current.type = 0;
+                // We don't know -yet- the actual offset of this label
+                current.raw_data = arg.value;
+                label_arguments.push_back(current_index);
+                break;
+            case Token_Type::Array: {
+                // Written out as its length followed by its elements, the length is patched once they are all read
+                const size_t array_start = script.array_data.size();
+                script.array_offsets.push_back(static_cast<u32>(array_start));
+                script.array_data.push_back(0);
+
+                std::string_view elements{arg.text};
+                while (!elements.empty()) {
+                    const std::string_view element = elements.substr(0, elements.find(' '));
+                    elements.remove_prefix(std::min(element.size() + 1, elements.size()));
+                    if (element.empty()) continue;
+
+                    u32 value{};
+                    if (!parse_hex(element, value)) {
+                        fail("Bad array element for %.*s on line %d.", (int)instruction.size(), instruction.data(), line_count);
                     }
-
-                    // We'll have to "restore" this argument's data later on as the offset where the array will be written
-                    current.type = 0;
-                    current.data_array = {(u32)data.size(), data};
-                    array_arguments.push_back(current_index);
-                } else if (!arg[ARGUMENT_TYPE::VALUE].empty()) {
-                    current.type = 0;
-                    current.raw_data = std::stoul(arg[VALUE], nullptr, 16);
-                } else {
-                    fprintf(stderr, "Bad argument for %s on line %d.\n", instruction.c_str(), line_count);
-                    _exit(-1);
+                    script.array_data.push_back(value);
                 }
+                script.array_data[array_start] = static_cast<u32>(script.array_data.size() - array_start - 1);
+
+                // We'll have to "restore" this argument's data later on as the offset where the array will be written
+                current.type = 0;
+                current.raw_data = static_cast<u32>(script.array_offsets.size() - 1);
+                array_arguments.push_back(current_index);
+                break;
             }
+            case Token_Type::Value:
+                current.type = 0;
+                current.raw_data = arg.value;
+                break;
+            default:
+                fail("Bad argument for %.*s on line %d.", (int)instruction.size(), instruction.data(), line_count);
+            }
+        }
+
+        if (definition->argument_count != argument_count) {
+            fail("Argument mismatch for %.*s on line %d : expected %d args but found %d.", (int)instruction.size(), instruction.data(), line_count,
+                 definition->argument_count, argument_count);
         }
 
         if (definition->op_code == 0x3)        instr_3_offsets.insert(data_array_end);
         else if (definition->op_code == 0x71) instr_71_offsets.insert(data_array_end);
         else if (definition->op_code == 0x8F) instr_8f_offsets.insert(data_array_end);
 
-        data_array_end += compute_length(*definition);
-        line_count++;
+        data_array_end += op_code_info(definition->op_code).length;
     }
 
-    // Before writing our instructions, we need to restore the label, string and array offsets
-    for (auto& [instr_idx, arg_idx] : label_arguments) {
-        Instruction* instr = &instructions[instr_idx];
-        Argument* arg = instr->GetArgument(arg_idx);
-        arg->raw_data = (label_to_offset[arg->raw_data] - header.GetLength()) >> 2;
+    lex_timer.stop();
+    if (stats) {
+        // The strings were timed on their own
+        stats->time(Stats_Phase::Lex) -= stats->time(Stats_Phase::String_Pool) - string_pool_before;
+        stats->instructions += script.instructions.size();
+        stats->strings += script.string_offsets.size();
+        stats->arrays += script.array_offsets.size();
+        stats->labels += label_to_offset.size();
     }
 
-    // Restore the strings offsets
-    std::string string_data;
-    string_data.reserve(5'000);
-    u32 current_string_offset = data_array_end;
-    for (auto& [instr_idx, arg_idx] : string_arguments) {
-        Instruction* instr = &instructions[instr_idx];
-        Argument* arg = instr->GetArgument(arg_idx);
-
-        arg->raw_data = (current_string_offset - header.GetLength()) >> 2;
-        // we have at least one 0xFF as a separator, + as many as needed to reach a multiple of four for the next offset.
-        if (header.IsVer5()) {
-            current_string_offset += (arg->decoded_stringv5.length() + 1) * 2;
-
-            for (u32 i = 0; i < arg->decoded_stringv5.length() * 2; i++) {
-                string_data += ((char*)arg->decoded_stringv5.data())[i] ^ 0xFF;
-            }
-
-            u32 padding = 4 - (current_string_offset % 4);
-            for (u32 i = 0; i < padding + 2; i++) {
-                string_data += 0xFF;
-            }
-            current_string_offset += padding;
-        }
-        else {
-            current_string_offset += arg->decoded_stringv4.length() + 1;
-
-            for (u32 i = 0; i < arg->decoded_stringv4.length(); i++) {
-                string_data += arg->decoded_stringv4[i] ^ 0xFF;
-            }
-
-            u32 padding = 4 - (current_string_offset % 4);
-            for (u32 i = 0; i < padding + 1; i++) {
-                string_data += 0xFF;
-            }
-            current_string_offset += padding;
-        }
+    // Before writing our instructions, we need to restore the label, string and array offsets
+    Phase_Timer fixup_timer(stats, Stats_Phase::Label_Fixup);
+    for (const u32 index : label_arguments) {
+        Argument& arg = script.arguments[index];
+        arg.raw_data = (label_to_offset[arg.raw_data] - header.GetLength()) >> 2;
     }
 
-    // assemble the offset indexing of the footer
-    std::vector<u32> footer_data;
-    footer_data.reserve(1'000);
+    // Restore the strings offsets, the pool starts right after the instructions
+    for (const u32 index : string_arguments) {
+        Argument& arg = script.arguments[index];
+        arg.raw_data = (data_array_end + script.string_offsets[arg.raw_data] - header.GetLength()) >> 2;
+    }
+    const u32 current_string_offset = data_array_end + static_cast<u32>(script.string_data.size());
+    fixup_timer.stop();
+
+    // assemble the offset indexing of the footer, the arrays come first and are already in place
+    Phase_Timer footer_timer(stats, Stats_Phase::Footer);
+    std::pmr::vector<u32> footer_data{scratch};
+    footer_data.reserve(script.array_data.size() + 1'000);
+    footer_data.assign(script.array_data.begin(), script.array_data.end());
     // Restore the array offsets
-    u32 current_array_offset = (current_string_offset - header.GetLength()) >> 2;
-    for (auto& [instr_idx, arg_idx] : array_arguments) {
-        Instruction* instr = &instructions[instr_idx];
-        Argument* arg = instr->GetArgument(arg_idx);
-
-        arg->raw_data = current_array_offset;
-        footer_data.push_back(arg->data_array.length);
-        current_array_offset += arg->data_array.length + 1;
-        footer_data.insert(footer_data.end(), 
-                           arg->data_array.data.begin(), arg->data_array.data.end());
+    const u32 arrays_start = (current_string_offset - header.GetLength()) >> 2;
+    for (const u32 index : array_arguments) {
+        Argument& arg = script.arguments[index];
+        arg.raw_data = arrays_start + script.array_offsets[arg.raw_data];
     }
+    const u32 current_array_offset = arrays_start + static_cast<u32>(script.array_data.size());
 
-    std::vector<u32> instr_71_vec;
+    std::pmr::vector<u32> instr_71_vec{scratch};
     instr_71_vec.reserve(instr_71_offsets.size());
     std::for_each(instr_71_offsets.begin(), instr_71_offsets.end(), 
                   [&](u32 offset) { instr_71_vec.push_back((offset - header.GetLength()) >> 2); });
@@ -353,7 +344,7 @@ std::stringstream assemble(std::istream& fd) {
     binary_header.table_1_length = instr_71_vec.size();
     binary_header.table_1_offset = current_array_offset;
 
-    std::vector<u32> instr_3_vec;
+    std::pmr::vector<u32> instr_3_vec{scratch};
     instr_3_vec.reserve(instr_3_offsets.size());
     std::for_each(instr_3_offsets.begin(), instr_3_offsets.end(),
         [&](u32 offset) { instr_3_vec.push_back((offset - header.GetLength()) >> 2); });
@@ -362,7 +353,7 @@ std::stringstream assemble(std::istream& fd) {
     binary_header.table_2_length = instr_3_vec.size();
     binary_header.table_2_offset = binary_header.table_1_offset + binary_header.table_1_length;
 
-    std::vector<u32> instr_8f_vec;
+    std::pmr::vector<u32> instr_8f_vec{scratch};
     instr_8f_vec.reserve(instr_3_offsets.size());
     std::for_each(instr_8f_offsets.begin(), instr_8f_offsets.end(),
         [&](u32 offset) { instr_8f_vec.push_back((offset - header.GetLength()) >> 2); });
@@ -371,5 +362,21 @@ std::stringstream assemble(std::istream& fd) {
     binary_header.table_3_length = instr_8f_vec.size();
     binary_header.table_3_offset = binary_header.table_2_offset + binary_header.table_2_length;
 
-    return write_assembled_file(header, instructions, string_data, footer_data);
-}
\ No newline at end of file
+    footer_timer.stop();
+
+    Phase_Timer emit_timer(stats, Stats_Phase::Emit);
+    write_assembled_file(header, script, data_array_end, footer_data, output);
+}
+
+Result assemble(std::string_view text, Output_Buffer& output, std::pmr::memory_resource* scratch, Script_Stats* stats) {
+    const size_t start = output.size();
+    Result result = capture_errors([&] { assemble_script(text, output, scratch, stats); });
+    if (result && stats) {
+        stats->bytes_in += text.size();
+        stats->bytes_out += output.size() - start;
+    }
+    if (!result) {
+        output.truncate(start);
+    }
+    return result;
+}
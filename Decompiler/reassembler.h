@@ -1,5 +1,15 @@
 #pragma once
-#include <regex>
+#include <memory_resource>
+#include <string_view>
 #include <unordered_map>
 
-std::stringstream assemble(std::istream& input);
\ No newline at end of file
+#include "age-error.h"
+#include "output-buffer.h"
+#include "script-stats.h"
+
+// Appends the script image built from its text form to output. Safe to call from any number of threads at once.
+// All the per-file containers are allocated from scratch, e.g. a worker's Scratch_Arena.
+// On failure nothing is appended and the Result says which line was wrong.
+// Counters and phase times are added to stats when there is one.
+Result assemble(std::string_view text, Output_Buffer& output, std::pmr::memory_resource* scratch = std::pmr::get_default_resource(),
+                Script_Stats* stats = nullptr);
\ No newline at end of file
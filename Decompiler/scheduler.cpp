@@ -0,0 +1,178 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <cctype>
+
+static bool extension_matches(const std::filesystem::path& path, std::string_view ext) {
+    const std::string file_ext = path.extension().string();
+    return std::ranges::equal(file_ext, ext, [](char a, char b) {
+        return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+    });
+}
+
+std::vector<Batch_File> collect_batch_files(const std::filesystem::path& input_dir, std::initializer_list<std::string_view> extensions) {
+    std::vector<Batch_File> files;
+
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(input_dir)) {
+        if (!entry.is_regular_file() ||
+            (extensions.size() > 0 && std::ranges::none_of(extensions, [&](std::string_view ext) { return extension_matches(entry.path(), ext); })) ||
+            entry.file_size() == 0) {
+            continue;
+        }
+        files.push_back({entry.path(), {}, entry.file_size()});
+    }
+
+    std::ranges::sort(files, [](const Batch_File& lhs, const Batch_File& rhs) {
+        return lhs.size != rhs.size ? lhs.size > rhs.size : lhs.input < rhs.input;
+    });
+
+    return files;
+}
+
+std::vector<Batch_File> collect_batch_files(const std::filesystem::path& input_dir, const std::filesystem::path& output_dir,
+                                            std::string_view in_ext, std::string_view out_ext) {
+    std::vector<Batch_File> files = collect_batch_files(input_dir, {in_ext});
+
+    for (auto& file : files) {
+        file.output = output_dir / std::filesystem::relative(file.input, input_dir);
+        file.output.replace_extension(out_ext);
+
+        const auto parent = file.output.parent_path();
+        if (!parent.empty() && !std::filesystem::is_directory(parent)) {
+            std::filesystem::create_directories(parent);
+        }
+    }
+
+    return files;
+}
+
+Thread_Pool::Thread_Pool(size_t thread_count) :
+    m_queues(std::max<size_t>(thread_count, 1)),
+    m_stats(m_queues.size()) {
+    m_threads.reserve(m_queues.size());
+    for (size_t i = 0; i < m_queues.size(); i++) {
+        m_threads.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+Thread_Pool::~Thread_Pool() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void Thread_Pool::run(size_t task_count, const std::function<void(size_t worker, size_t index)>& task) {
+    const auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < task_count; i++) {
+        m_queues[i % m_queues.size()].tasks.push_back(i);
+    }
+    std::ranges::fill(m_stats, Worker_Stats{});
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_task = &task;
+        m_active = m_threads.size();
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    {
+        std::unique_lock lock(m_mutex);
+        m_done.wait(lock, [this] { return m_active == 0; });
+        m_task = nullptr;
+    }
+
+    m_wall = std::chrono::steady_clock::now() - start;
+}
+
+bool Thread_Pool::next_task(size_t worker, size_t& index, bool& stolen) {
+    {
+        auto& own = m_queues[worker];
+        std::lock_guard lock(own.lock);
+        if (!own.tasks.empty()) {
+            index = own.tasks.front();
+            own.tasks.pop_front();
+            stolen = false;
+            return true;
+        }
+    }
+
+    // Our queue is empty : steal the most expensive task still queued, i.e. the lowest index at the front of any queue
+    while (true) {
+        size_t victim = m_queues.size();
+        size_t best = SIZE_MAX;
+        for (size_t i = 0; i < m_queues.size(); i++) {
+            if (i == worker) continue;
+            std::lock_guard lock(m_queues[i].lock);
+            if (!m_queues[i].tasks.empty() && m_queues[i].tasks.front() < best) {
+                best = m_queues[i].tasks.front();
+                victim = i;
+            }
+        }
+
+        if (victim == m_queues.size()) {
+            return false;
+        }
+
+        // The victim may have taken it in the meantime, look again if so
+        std::lock_guard lock(m_queues[victim].lock);
+        if (!m_queues[victim].tasks.empty() && m_queues[victim].tasks.front() == best) {
+            m_queues[victim].tasks.pop_front();
+            index = best;
+            stolen = true;
+            return true;
+        }
+    }
+}
+
+void Thread_Pool::worker_loop(size_t worker) {
+    u64 seen_generation = 0;
+
+    while (true) {
+        const std::function<void(size_t, size_t)>* task;
+        {
+            std::unique_lock lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_generation != seen_generation; });
+            if (m_stop) {
+                return;
+            }
+            seen_generation = m_generation;
+            task = m_task;
+        }
+
+        auto& stats = m_stats[worker];
+        size_t index;
+        bool stolen;
+        while (next_task(worker, index, stolen)) {
+            const auto start = std::chrono::steady_clock::now();
+            (*task)(worker, index);
+            stats.busy += std::chrono::steady_clock::now() - start;
+            stats.tasks++;
+            stats.stolen += stolen;
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            if (--m_active == 0) {
+                m_done.notify_all();
+            }
+        }
+    }
+}
+
+void Thread_Pool::print_utilization(FILE* out) const {
+    const double wall = std::chrono::duration<double>(m_wall).count();
+
+    for (size_t i = 0; i < m_stats.size(); i++) {
+        const double busy = std::chrono::duration<double>(m_stats[i].busy).count();
+        fprintf(out, "Worker %2zu : %zu files (%zu stolen), busy %.3fs (%.1f%%)\n",
+                i, m_stats[i].tasks, m_stats[i].stolen, busy, wall > 0 ? 100.0 * busy / wall : 0.0);
+    }
+}
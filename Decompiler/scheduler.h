@@ -0,0 +1,79 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "types.h"
+
+struct Batch_File {
+    std::filesystem::path input;
+    std::filesystem::path output;
+    u64 size;
+};
+
+// Recursively collects every non-empty file under input_dir with one of the given extensions (case-insensitively, any extension
+// when there are none), largest first.
+// Only the input and size of each entry are filled in.
+std::vector<Batch_File> collect_batch_files(const std::filesystem::path& input_dir, std::initializer_list<std::string_view> extensions);
+
+// Recursively collects every non-empty file under input_dir whose extension matches in_ext (case-insensitively).
+// Outputs mirror the input tree under output_dir with out_ext, and their directories are created up front.
+// The result is sorted largest first, so the biggest scripts start before the small ones.
+std::vector<Batch_File> collect_batch_files(const std::filesystem::path& input_dir, const std::filesystem::path& output_dir,
+                                            std::string_view in_ext, std::string_view out_ext);
+
+// Fixed set of worker threads that can run any number of batches.
+// Tasks are dealt round-robin into per-worker queues, and a worker whose queue runs dry steals the most expensive task left elsewhere.
+class Thread_Pool {
+public:
+    struct Worker_Stats {
+        size_t tasks{};
+        size_t stolen{};
+        std::chrono::nanoseconds busy{};
+    };
+
+    explicit Thread_Pool(size_t thread_count);
+    ~Thread_Pool();
+
+    Thread_Pool(const Thread_Pool&) = delete;
+    Thread_Pool& operator=(const Thread_Pool&) = delete;
+
+    size_t size() const {
+        return m_threads.size();
+    }
+
+    // Calls task(worker, index) for every index below task_count and blocks until all of them are done.
+    // Indices should be ordered from most to least expensive.
+    void run(size_t task_count, const std::function<void(size_t worker, size_t index)>& task);
+
+    // Prints how busy each worker was during the last run
+    void print_utilization(FILE* out) const;
+
+private:
+    struct Worker_Queue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    void worker_loop(size_t worker);
+    bool next_task(size_t worker, size_t& index, bool& stolen);
+
+    std::vector<std::thread> m_threads;
+    std::vector<Worker_Queue> m_queues;
+    std::vector<Worker_Stats> m_stats;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void(size_t, size_t)>* m_task{};
+    u64 m_generation{};
+    size_t m_active{};
+    bool m_stop{};
+    std::chrono::nanoseconds m_wall{};
+};
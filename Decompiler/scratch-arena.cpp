@@ -0,0 +1,47 @@
+#include "scratch-arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+void* Scratch_Arena::do_allocate(size_t bytes, size_t alignment) {
+    while (m_current < m_blocks.size()) {
+        const Block& block = m_blocks[m_current];
+        const uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+        const uintptr_t aligned = (base + m_used + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+        if (aligned + bytes <= base + block.size) {
+            m_used = aligned + bytes - base;
+            return reinterpret_cast<void*>(aligned);
+        }
+
+        // Doesn't fit, the rest of this block goes unused until the next reset
+        m_current++;
+        m_used = 0;
+    }
+
+    const size_t size = std::max(m_block_size, bytes + alignment);
+    m_blocks.push_back({std::make_unique_for_overwrite<std::byte[]>(size), size});
+    m_current = m_blocks.size() - 1;
+    m_used = 0;
+    return do_allocate(bytes, alignment);
+}
+
+void Scratch_Arena::reset() {
+    // A file which needed several blocks will likely be followed by similar ones :
+    // merge them into a single block, so the steady state never goes back to the system allocator
+    if (m_blocks.size() > 1) {
+        const size_t total = capacity();
+        m_blocks.clear();
+        m_blocks.push_back({std::make_unique_for_overwrite<std::byte[]>(total), total});
+    }
+
+    m_current = 0;
+    m_used = 0;
+}
+
+size_t Scratch_Arena::capacity() const {
+    size_t total = 0;
+    for (const auto& block : m_blocks) {
+        total += block.size;
+    }
+    return total;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+#include "types.h"
+
+// Bump allocator for the per-file containers of disassemble() / assemble().
+// Deallocation is a no-op : everything is released at once by reset(), which keeps the memory for the next file.
+// Not thread-safe, every worker owns one.
+class Scratch_Arena final : public std::pmr::memory_resource {
+public:
+    explicit Scratch_Arena(size_t block_size = 1 << 20) : m_block_size(block_size) {}
+
+    Scratch_Arena(const Scratch_Arena&) = delete;
+    Scratch_Arena& operator=(const Scratch_Arena&) = delete;
+
+    // Forgets every allocation. Nothing allocated from the arena may be used afterwards.
+    void reset();
+
+    size_t capacity() const;
+
+private:
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    std::vector<Block> m_blocks;
+    size_t m_current{}; // block being carved from
+    size_t m_used{};    // bytes of it handed out
+    size_t m_block_size;
+};
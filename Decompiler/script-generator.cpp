@@ -0,0 +1,123 @@
+#include "age-shared.h"
+#include "script-generator.h"
+
+#include <array>
+#include <string_view>
+
+// splitmix64, identical on every platform and standard library unlike the <random> distributions
+struct Split_Mix {
+    u64 state;
+
+    u64 next() {
+        u64 z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // In [0, bound)
+    u32 below(u32 bound) {
+        return static_cast<u32>(next() % bound);
+    }
+
+    bool chance(u32 percent) {
+        return below(100) < percent;
+    }
+};
+
+// Pieces of dialogue, all of them encodable in CP932
+static constexpr std::array<std::string_view, 24> TEXT_PIECES{
+    "「", "」", "……", "、", "。", "！", "？", "ああ", "そうか", "わかった", "行くぞ", "待って",
+    "お前", "私は", "魔法", "剣", "ｶﾀｶﾅ", "村", "王国", "戦い", "Hello", " ", "ABC xyz", "123",
+};
+
+static constexpr std::array<std::string_view, 11> REGISTER_TYPES{
+    "local-int", "local-int", "local-int", "local-ptr", "global-int", "global-float",
+    "global-string", "global-ptr", "local-float", "local-string", "float",
+};
+
+static constexpr u32 LABEL_SPACING = 8; // every 8th instruction can be jumped to
+
+static void append_string(Split_Mix& random, Output_Buffer& output) {
+    output.append('"');
+    for (u32 pieces = 1 + random.below(12); pieces > 0; pieces--) {
+        output.append(TEXT_PIECES[random.below(TEXT_PIECES.size())]);
+    }
+    output.append('"');
+}
+
+static void append_label(Split_Mix& random, u32 instruction_count, Output_Buffer& output) {
+    output.append("label_");
+    output.append_hex(random.below((instruction_count + LABEL_SPACING - 1) / LABEL_SPACING) * LABEL_SPACING, 8);
+}
+
+void generate_script(const Generator_Options& options, Output_Buffer& output) {
+    Split_Mix random{options.seed};
+
+    // Every known op code, and the few which dominate real scripts
+    std::vector<const Instruction_Definition*> definitions;
+    for (u32 op_code = 0; op_code < OP_CODE_LIMIT; op_code++) {
+        if (op_code_info(op_code).definition) {
+            definitions.push_back(op_code_info(op_code).definition);
+        }
+    }
+    const Instruction_Definition* show_text = op_code_info(0x6E).definition;
+    const Instruction_Definition* jump = op_code_info(0x8C).definition;
+    const Instruction_Definition* branch = op_code_info(0xA0).definition;
+
+    output.append("==Binary Information - do not edit==\n");
+    output.append(options.version_5 ? "signature = SYS5501 \n" : "signature = SYS4415 \n");
+    output.append("local_vars = {");
+    for (u32 i = 0; i < 6; i++) {
+        output.append(' ');
+        output.append_hex(random.below(0x1000));
+    }
+    output.append(" }\n====\n\n");
+
+    for (u32 i = 0; i < options.instruction_count; i++) {
+        if (i % LABEL_SPACING == 0) {
+            output.append("\nlabel_");
+            output.append_hex(i, 8);
+            output.append('\n');
+        }
+
+        const u32 pick = random.below(100);
+        const Instruction_Definition* definition = pick < 15 ? show_text
+                                                 : pick < 20 ? branch
+                                                 : pick < 23 ? jump
+                                                 : definitions[random.below(static_cast<u32>(definitions.size()))];
+
+        output.append(definition->label);
+        for (u32 x = 0; x < definition->argument_count; x++) {
+            output.append(' ');
+            if (is_control_flow(definition) && is_label_argument(definition, x, Argument{})) {
+                append_label(random, options.instruction_count, output);
+            } else if (is_array(definition) && x == 1) {
+                output.append('[');
+                for (u32 length = random.below(9), e = 0; e < length; e++) {
+                    if (e > 0) output.append(' ');
+                    output.append_hex(random.below(0x10000));
+                }
+                output.append(']');
+            } else if (is_array(definition)) {
+                // Untyped, this would read as an empty array
+                output.append("(local-int ");
+                output.append_hex(random.below(0x100));
+                output.append(')');
+            } else if (is_control_flow(definition)) {
+                output.append_hex(random.below(0x100));
+            } else if (random.chance(definition == show_text ? 70 : 15)) {
+                append_string(random, output);
+            } else if (random.chance(60)) {
+                output.append('(');
+                output.append(REGISTER_TYPES[random.below(REGISTER_TYPES.size())]);
+                output.append(' ');
+                output.append_hex(random.below(0x1000));
+                output.append(')');
+            } else {
+                output.append_hex(static_cast<u32>(random.next()));
+            }
+        }
+        output.append('\n');
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <vector>
+
+#include "output-buffer.h"
+#include "types.h"
+
+// Deterministic synthetic scripts for benchmarking, so results can be reproduced without any game data.
+// Scripts are generated in text form and are valid input for assemble() : every op code of the definitions table shows up,
+// with strings, registers, arrays and labels in roughly the proportions of real scripts.
+struct Generator_Options {
+    bool version_5{};         // SYS5 (UTF16 strings) rather than SYS4 (CP932)
+    u32 instruction_count{100'000};
+    u64 seed{1};
+};
+
+void generate_script(const Generator_Options& options, Output_Buffer& output);
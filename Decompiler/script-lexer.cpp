@@ -0,0 +1,192 @@
+#include "script-lexer.h"
+
+#include <algorithm>
+
+static constexpr bool is_word_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+static constexpr bool is_hex_char(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static constexpr bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+std::string_view Script_Lexer::read_line() {
+    const size_t start = m_pos;
+    size_t end = m_source.find('\n', m_pos);
+    if (end == std::string_view::npos) {
+        end = m_source.size();
+        m_pos = end;
+    } else {
+        m_pos = end + 1;
+        m_line++;
+    }
+
+    std::string_view line = m_source.substr(start, end - start);
+    if (line.ends_with('\r')) {
+        line.remove_suffix(1);
+    }
+    return line;
+}
+
+Token Script_Lexer::next() {
+    while (true) {
+        while (m_pos < m_source.size() && is_blank(m_source[m_pos])) {
+            m_pos++;
+        }
+
+        if (m_pos >= m_source.size()) {
+            if (!m_at_line_start) {
+                m_at_line_start = true;
+                return {Token_Type::Newline};
+            }
+            return {Token_Type::End};
+        }
+
+        const char c = m_source[m_pos];
+        const char next_c = m_pos + 1 < m_source.size() ? m_source[m_pos + 1] : '\0';
+
+        if (c == '\n') {
+            m_pos++;
+            m_line++;
+            // Empty and comment-only lines produce no tokens at all
+            if (m_at_line_start) {
+                continue;
+            }
+            m_at_line_start = true;
+            return {Token_Type::Newline};
+        }
+
+        if (c == '/' && next_c == '/') {
+            m_pos = std::min(m_source.find('\n', m_pos), m_source.size());
+            continue;
+        }
+
+        if (c == '/' && next_c == '*') {
+            const size_t end = m_source.find("*/", m_pos + 2);
+            const size_t stop = end == std::string_view::npos ? m_source.size() : end + 2;
+            for (size_t i = m_pos; i < stop; i++) {
+                m_line += m_source[i] == '\n';
+            }
+            m_pos = stop;
+            continue;
+        }
+
+        if (m_at_line_start) {
+            m_at_line_start = false;
+            return lex_word();
+        }
+
+        switch (c) {
+        case '(': return lex_register();
+        case '"': return lex_delimited(Token_Type::String, '"');
+        case '[': return lex_delimited(Token_Type::Array, ']');
+        default:
+            if (m_source.substr(m_pos).starts_with("label_")) {
+                return lex_label();
+            }
+            if (is_hex_char(c)) {
+                return lex_value();
+            }
+            return {Token_Type::Error, m_source.substr(m_pos++, 1)};
+        }
+    }
+}
+
+Token Script_Lexer::lex_word() {
+    const size_t start = m_pos;
+    while (m_pos < m_source.size() && is_word_char(m_source[m_pos])) {
+        m_pos++;
+    }
+
+    const std::string_view word = m_source.substr(start, m_pos - start);
+    if (word.empty()) {
+        return {Token_Type::Error, m_source.substr(m_pos++, 1)};
+    }
+    if (word.starts_with("label_")) {
+        Token token{Token_Type::Label, word};
+        if (!parse_hex(word.substr(6), token.value)) {
+            token.type = Token_Type::Error;
+        }
+        return token;
+    }
+    return {Token_Type::Identifier, word};
+}
+
+Token Script_Lexer::lex_register() {
+    // (global-int 17A)
+    const size_t start = m_pos++;
+    const size_t name_start = m_pos;
+    while (m_pos < m_source.size() && is_word_char(m_source[m_pos])) {
+        m_pos++;
+    }
+    const size_t name_end = m_pos;
+
+    while (m_pos < m_source.size() && is_blank(m_source[m_pos])) {
+        m_pos++;
+    }
+
+    const size_t value_start = m_pos;
+    while (m_pos < m_source.size() && is_hex_char(m_source[m_pos])) {
+        m_pos++;
+    }
+    const size_t value_end = m_pos;
+
+    if (name_end == name_start || value_end == value_start || value_start == name_end ||
+        m_pos >= m_source.size() || m_source[m_pos] != ')') {
+        return {Token_Type::Error, m_source.substr(start, m_pos - start)};
+    }
+    m_pos++;
+
+    Token token{Token_Type::Register, m_source.substr(name_start, name_end - name_start)};
+    if (!parse_hex(m_source.substr(value_start, value_end - value_start), token.value)) {
+        token.type = Token_Type::Error;
+    }
+    return token;
+}
+
+Token Script_Lexer::lex_delimited(Token_Type type, char close) {
+    // Strings and arrays both run up to the first closing character on the same line
+    const size_t start = m_pos + 1;
+    const size_t end = m_source.find(close, start);
+    const size_t line_end = m_source.find('\n', start);
+
+    if (end == std::string_view::npos || end > line_end) {
+        m_pos = std::min(line_end, m_source.size());
+        return {Token_Type::Error, m_source.substr(start - 1, m_pos - start + 1)};
+    }
+
+    m_pos = end + 1;
+    return {type, m_source.substr(start, end - start)};
+}
+
+Token Script_Lexer::lex_label() {
+    const size_t start = m_pos;
+    m_pos += 6;
+    const size_t digits = m_pos;
+    while (m_pos < m_source.size() && is_hex_char(m_source[m_pos])) {
+        m_pos++;
+    }
+
+    Token token{Token_Type::Label, m_source.substr(start, m_pos - start)};
+    if (!parse_hex(m_source.substr(digits, m_pos - digits), token.value)) {
+        token.type = Token_Type::Error;
+    }
+    return token;
+}
+
+Token Script_Lexer::lex_value() {
+    const size_t start = m_pos;
+    while (m_pos < m_source.size() && is_hex_char(m_source[m_pos])) {
+        m_pos++;
+    }
+
+    Token token{Token_Type::Value, m_source.substr(start, m_pos - start)};
+    if ((m_pos < m_source.size() && is_word_char(m_source[m_pos])) || !parse_hex(token.text, token.value)) {
+        token.type = Token_Type::Error;
+    }
+    return token;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <charconv>
+#include <string_view>
+
+#include "types.h"
+
+enum class Token_Type {
+    End,        // end of the script
+    Newline,    // end of a line that held at least one token
+    Identifier, // instruction mnemonic, always the first word of a line
+    Label,      // label_XXXXXXXX, either as a line of its own or as an argument
+    Register,   // (type value), text holds the type name
+    String,     // "text", text holds the contents without the quotes
+    Array,      // [a b c], text holds the contents without the brackets
+    Value,      // bare hex literal
+    Error,
+};
+
+struct Token {
+    Token_Type type{Token_Type::End};
+    std::string_view text{};
+    u32 value{};
+};
+
+// Parses the whole of text as a hex number, fails on empty input, trailing garbage or overflow
+inline bool parse_hex(std::string_view text, u32& value) {
+    const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value, 16);
+    return ec == std::errc{} && ptr == text.data() + text.size();
+}
+
+// Single-pass tokenizer over a disassembled script. Tokens are views into the source, nothing is allocated.
+// Blank lines, // line comments and /* */ block comments are skipped entirely.
+class Script_Lexer {
+public:
+    explicit Script_Lexer(std::string_view source) : m_source(source) {}
+
+    // Returns the next raw line without tokenizing it, for the header block.
+    std::string_view read_line();
+
+    Token next();
+
+    // 1-based line the lexer currently sits on
+    u32 line() const {
+        return m_line;
+    }
+
+private:
+    Token lex_word();
+    Token lex_register();
+    Token lex_delimited(Token_Type type, char close);
+    Token lex_label();
+    Token lex_value();
+
+    std::string_view m_source;
+    size_t m_pos{};
+    u32 m_line{1};
+    bool m_at_line_start{true};
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <string_view>
+#include <utility>
+
+#include "alloc-profile.h"
+#include "types.h"
+
+// Where the time of a script goes. The first group is disassembly, the second assembly, Read and Write are up to the caller.
+enum class Stats_Phase {
+    Read,
+    Header,
+    Decode,     // instruction stream, without the strings
+    Label_Scan,
+    Transcode,  // strings out of the pool and into UTF8
+    Format,
+    Lex,        // text into instructions, without the strings
+    String_Pool,
+    Label_Fixup,
+    Footer,
+    Emit,
+    Write,
+    COUNT,
+};
+
+inline constexpr size_t STATS_PHASE_COUNT = static_cast<size_t>(Stats_Phase::COUNT);
+
+inline constexpr std::string_view stats_phase_name(Stats_Phase phase) {
+    constexpr std::array<std::string_view, STATS_PHASE_COUNT> names{
+        "read", "header", "decode", "label_scan", "transcode", "format",
+        "lex", "string_pool", "label_fixup", "footer", "emit", "write",
+    };
+    return names[static_cast<size_t>(phase)];
+}
+
+// Told about every phase as it ends, e.g. to lay them out on a timeline
+class Phase_Listener {
+public:
+    virtual ~Phase_Listener() = default;
+    virtual void phase_done(Stats_Phase phase, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) = 0;
+};
+
+// Counters and phase times of one script, filled in by disassemble() / assemble() when they are given one
+struct Script_Stats {
+    u64 bytes_in{};
+    u64 bytes_out{};
+    u64 instructions{};
+    u64 strings{};
+    u64 arrays{};
+    u64 labels{};
+    std::array<u64, STATS_PHASE_COUNT> nanoseconds{};
+    std::array<Alloc_Stats, STATS_PHASE_COUNT> allocations{}; // only counted by AGE_ALLOC_PROFILE builds
+    Phase_Listener* listener{};
+
+    u64& time(Stats_Phase phase) {
+        return nanoseconds[static_cast<size_t>(phase)];
+    }
+
+    u64 total_time() const {
+        u64 total = 0;
+        for (const u64 time : nanoseconds) total += time;
+        return total;
+    }
+
+    void add(const Script_Stats& other) {
+        bytes_in += other.bytes_in;
+        bytes_out += other.bytes_out;
+        instructions += other.instructions;
+        strings += other.strings;
+        arrays += other.arrays;
+        labels += other.labels;
+        for (size_t i = 0; i < STATS_PHASE_COUNT; i++) nanoseconds[i] += other.nanoseconds[i];
+        for (size_t i = 0; i < STATS_PHASE_COUNT; i++) allocations[i].add(other.allocations[i]);
+    }
+};
+
+// Adds the time until it is stopped or destroyed to one phase, and charges the allocations in between to it.
+// Costs nothing but a null check without stats.
+class Phase_Timer {
+public:
+    Phase_Timer(Script_Stats* stats, Stats_Phase phase) : m_stats(stats), m_phase(phase) {
+        if (!m_stats) return;
+        m_previous_scope = std::exchange(alloc_scope, {&m_stats->allocations[static_cast<size_t>(phase)], alloc_live});
+        m_start = std::chrono::steady_clock::now();
+    }
+
+    ~Phase_Timer() {
+        stop();
+    }
+
+    Phase_Timer(const Phase_Timer&) = delete;
+    Phase_Timer& operator=(const Phase_Timer&) = delete;
+
+    void stop() {
+        if (!m_stats) return;
+        const auto end = std::chrono::steady_clock::now();
+        alloc_scope = m_previous_scope;
+        m_stats->time(m_phase) += std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count();
+        if (m_stats->listener) {
+            m_stats->listener->phase_done(m_phase, m_start, end);
+        }
+        m_stats = nullptr;
+    }
+
+private:
+    Script_Stats* m_stats;
+    Stats_Phase m_phase;
+    std::chrono::steady_clock::time_point m_start;
+    Alloc_Scope m_previous_scope;
+};
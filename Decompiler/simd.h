@@ -0,0 +1,43 @@
+#pragma once
+// SIMD capabilities shared by the vectorized kernels.
+// SSE2 is a compile-time baseline on x64, AVX2 kernels are compiled in and selected at runtime.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AGE_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(AGE_HAVE_SSE2) && (defined(__x86_64__) || defined(_M_X64))
+#define AGE_HAVE_AVX2 1
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define AGE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#include <intrin.h>
+#define AGE_TARGET_AVX2
+#endif
+
+inline bool cpu_has_avx2() {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_cpu_supports("avx2");
+#else
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) {
+        return false;
+    }
+
+    // The OS has to save the YMM registers too
+    __cpuid(regs, 1);
+    const bool osxsave = regs[2] & (1 << 27);
+    const bool avx = regs[2] & (1 << 28);
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+
+    __cpuidex(regs, 7, 0);
+    return regs[1] & (1 << 5);
+#endif
+}
+#endif
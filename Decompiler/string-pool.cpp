@@ -0,0 +1,202 @@
+#include "string-pool.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#ifdef AGE_HAVE_AVX2
+static const bool use_avx2 = cpu_has_avx2();
+#endif
+
+// The decode kernels XOR a run of UNIT-sized characters into out and stop at the first terminator.
+// They return the number of bytes before the terminator, or size when the run does not contain one.
+// out must have room for the whole run, blocks are stored in full even when they hold the terminator.
+
+template <size_t UNIT>
+static size_t decode_run_scalar(const u8* in, size_t size, u8* out) {
+    size_t pos = 0;
+    for (; size - pos >= UNIT; pos += UNIT) {
+        if (in[pos] == 0xFF && (UNIT == 1 || in[pos + 1] == 0xFF)) {
+            return pos;
+        }
+        for (size_t i = 0; i < UNIT; i++) {
+            out[pos + i] = in[pos + i] ^ 0xFF;
+        }
+    }
+    return size;
+}
+
+static void xor_run_scalar(const u8* in, size_t size, u8* out) {
+    for (size_t pos = 0; pos < size; pos++) {
+        out[pos] = in[pos] ^ 0xFF;
+    }
+}
+
+#ifdef AGE_HAVE_SSE2
+template <size_t UNIT>
+static size_t decode_run_sse2(const u8* in, size_t size, u8* out) {
+    const __m128i ones = _mm_set1_epi8(-1);
+    size_t pos = 0;
+    for (; size - pos >= 16; pos += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + pos));
+        const __m128i terminator = UNIT == 1 ? _mm_cmpeq_epi8(block, ones) : _mm_cmpeq_epi16(block, ones);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + pos), _mm_xor_si128(block, ones));
+
+        const u32 mask = static_cast<u32>(_mm_movemask_epi8(terminator));
+        if (mask != 0) {
+            return pos + std::countr_zero(mask);
+        }
+    }
+    const size_t tail = decode_run_scalar<UNIT>(in + pos, size - pos, out + pos);
+    return pos + tail;
+}
+
+static void xor_run_sse2(const u8* in, size_t size, u8* out) {
+    const __m128i ones = _mm_set1_epi8(-1);
+    size_t pos = 0;
+    for (; size - pos >= 16; pos += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + pos));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + pos), _mm_xor_si128(block, ones));
+    }
+    xor_run_scalar(in + pos, size - pos, out + pos);
+}
+#endif
+
+#ifdef AGE_HAVE_AVX2
+template <size_t UNIT>
+AGE_TARGET_AVX2 static size_t decode_run_avx2(const u8* in, size_t size, u8* out) {
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t pos = 0;
+    for (; size - pos >= 32; pos += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + pos));
+        const __m256i terminator = UNIT == 1 ? _mm256_cmpeq_epi8(block, ones) : _mm256_cmpeq_epi16(block, ones);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + pos), _mm256_xor_si256(block, ones));
+
+        const u32 mask = static_cast<u32>(_mm256_movemask_epi8(terminator));
+        if (mask != 0) {
+            return pos + std::countr_zero(mask);
+        }
+    }
+    const size_t tail = decode_run_sse2<UNIT>(in + pos, size - pos, out + pos);
+    return pos + tail;
+}
+
+AGE_TARGET_AVX2 static void xor_run_avx2(const u8* in, size_t size, u8* out) {
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t pos = 0;
+    for (; size - pos >= 32; pos += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + pos));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + pos), _mm256_xor_si256(block, ones));
+    }
+    xor_run_sse2(in + pos, size - pos, out + pos);
+}
+#endif
+
+template <size_t UNIT>
+static size_t decode_run(const u8* in, size_t size, u8* out) {
+#ifdef AGE_HAVE_AVX2
+    if (use_avx2) {
+        return decode_run_avx2<UNIT>(in, size, out);
+    }
+#endif
+#ifdef AGE_HAVE_SSE2
+    return decode_run_sse2<UNIT>(in, size, out);
+#else
+    return decode_run_scalar<UNIT>(in, size, out);
+#endif
+}
+
+static void xor_run(const u8* in, size_t size, u8* out) {
+#ifdef AGE_HAVE_AVX2
+    if (use_avx2) {
+        xor_run_avx2(in, size, out);
+        return;
+    }
+#endif
+#ifdef AGE_HAVE_SSE2
+    xor_run_sse2(in, size, out);
+#else
+    xor_run_scalar(in, size, out);
+#endif
+}
+
+template <typename String>
+static bool decode_string(std::span<const std::byte> data, size_t offset, String& output) {
+    constexpr size_t UNIT = sizeof(typename String::value_type);
+    if (offset > data.size()) {
+        return false;
+    }
+
+    const u8* in = reinterpret_cast<const u8*>(data.data()) + offset;
+    const size_t available = (data.size() - offset) / UNIT * UNIT;
+    const size_t start = output.size();
+
+    // The string length is unknown until the terminator shows up : decode in geometrically growing runs,
+    // so short strings stay cheap and long ones are still decoded in one pass.
+    size_t decoded = 0;
+    size_t run = 64;
+    while (decoded < available) {
+        run = std::min(run, available - decoded);
+        output.resize(start + (decoded + run) / UNIT);
+
+        u8* out = reinterpret_cast<u8*>(output.data() + start) + decoded;
+        const size_t length = decode_run<UNIT>(in + decoded, run, out);
+        decoded += length;
+
+        if (length < run) {
+            output.resize(start + decoded / UNIT);
+            return true;
+        }
+        run *= 2;
+    }
+
+    output.resize(start + decoded / UNIT);
+    return false;
+}
+
+template <typename Char, typename String>
+static void encode_string(std::basic_string_view<Char> input, String& pool) {
+    const size_t length = input.size() * sizeof(Char);
+    // Terminator plus padding up to the next 4 byte boundary. A string that already ends on one still gets a full 4 bytes.
+    const size_t total = ((length + sizeof(Char)) & ~size_t{3}) + 4;
+
+    const size_t start = pool.size();
+    pool.resize(start + total);
+
+    u8* out = reinterpret_cast<u8*>(pool.data()) + start;
+    xor_run(reinterpret_cast<const u8*>(input.data()), length, out);
+    std::memset(out + length, 0xFF, total - length);
+}
+
+bool decode_pool_string(std::span<const std::byte> data, size_t offset, std::string& output) {
+    return decode_string(data, offset, output);
+}
+
+bool decode_pool_string(std::span<const std::byte> data, size_t offset, std::u16string& output) {
+    return decode_string(data, offset, output);
+}
+
+bool decode_pool_string(std::span<const std::byte> data, size_t offset, std::pmr::string& output) {
+    return decode_string(data, offset, output);
+}
+
+bool decode_pool_string(std::span<const std::byte> data, size_t offset, std::pmr::u16string& output) {
+    return decode_string(data, offset, output);
+}
+
+void encode_pool_string(std::string_view input, std::string& pool) {
+    encode_string(input, pool);
+}
+
+void encode_pool_string(std::u16string_view input, std::string& pool) {
+    encode_string(input, pool);
+}
+
+void encode_pool_string(std::string_view input, std::pmr::string& pool) {
+    encode_string(input, pool);
+}
+
+void encode_pool_string(std::u16string_view input, std::pmr::string& pool) {
+    encode_string(input, pool);
+}
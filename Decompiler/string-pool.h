@@ -0,0 +1,23 @@
+#pragma once
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "types.h"
+
+// Script strings live in a pool after the instruction stream. Every character is XORed with 0xFF (0xFFFF in version 5),
+// strings are terminated by 0xFF (0xFFFF) and padded with more of it so the next string starts on a 4 byte boundary.
+// These kernels decode/encode a whole string at a time, 32 (AVX2) or 16 (SSE2) bytes per step.
+
+// Decodes the string at offset up to its terminator, appending it to output. Returns false if the terminator is missing.
+bool decode_pool_string(std::span<const std::byte> data, size_t offset, std::string& output);
+bool decode_pool_string(std::span<const std::byte> data, size_t offset, std::u16string& output);
+bool decode_pool_string(std::span<const std::byte> data, size_t offset, std::pmr::string& output);
+bool decode_pool_string(std::span<const std::byte> data, size_t offset, std::pmr::u16string& output);
+
+// Appends the encoded string, its terminator and padding to pool, whose size must be a multiple of 4.
+void encode_pool_string(std::string_view input, std::string& pool);
+void encode_pool_string(std::u16string_view input, std::string& pool);
+void encode_pool_string(std::string_view input, std::pmr::string& pool);
+void encode_pool_string(std::u16string_view input, std::pmr::string& pool);
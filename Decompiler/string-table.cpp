@@ -0,0 +1,281 @@
+#include "age-shared.h"
+#include "disassembler.h"
+#include "script-lexer.h"
+#include "string-pool.h"
+#include "string-table.h"
+
+#include <unordered_map>
+
+static void write_csv_field(std::string_view field, Output_Buffer& output) {
+    if (field.find_first_of(",\"\r\n") == std::string_view::npos) {
+        output.append(field);
+        return;
+    }
+
+    output.append('"');
+    for (size_t quote; (quote = field.find('"')) != std::string_view::npos; field.remove_prefix(quote + 1)) {
+        output.append(field.substr(0, quote + 1));
+        output.append('"');
+    }
+    output.append(field);
+    output.append('"');
+}
+
+void write_string_table(std::span<const String_Entry> strings, Output_Buffer& output) {
+    output.append("id,context,text\n");
+    for (const auto& entry : strings) {
+        output.append_hex(entry.offset, 8);
+        output.append(':');
+        output.append_hex(entry.argument);
+        output.append(',');
+        write_csv_field(entry.context, output);
+        output.append(',');
+        write_csv_field(entry.text, output);
+        output.append('\n');
+    }
+}
+
+// Reads one field starting at pos, leaving pos on the separator which ended it
+static bool read_csv_field(std::string_view csv, size_t& pos, std::string& field) {
+    field.clear();
+    if (pos >= csv.size() || csv[pos] != '"') {
+        const size_t end = std::min(csv.find_first_of(",\r\n", pos), csv.size());
+        field.assign(csv.substr(pos, end - pos));
+        pos = end;
+        return true;
+    }
+
+    for (pos++; pos < csv.size(); pos++) {
+        if (csv[pos] != '"') {
+            field.push_back(csv[pos]);
+        } else if (pos + 1 < csv.size() && csv[pos + 1] == '"') {
+            field.push_back('"');
+            pos++;
+        } else {
+            pos++;
+            return true;
+        }
+    }
+    return false; // unterminated quote
+}
+
+static void read_entries(std::string_view csv, std::vector<String_Entry>& strings) {
+    u32 line = 0;
+    size_t pos = 0;
+    std::array<std::string, 3> fields;
+
+    while (pos < csv.size()) {
+        line++;
+
+        size_t count = 0;
+        bool valid = true;
+        while (valid) {
+            std::string scratch;
+            valid = read_csv_field(csv, pos, count < fields.size() ? fields[count] : scratch);
+            count++;
+            if (pos >= csv.size() || csv[pos] != ',') break;
+            pos++;
+        }
+        // Line ending, CRLF or LF
+        if (pos < csv.size() && csv[pos] == '\r') pos++;
+        if (pos < csv.size() && csv[pos] == '\n') pos++;
+
+        if (count == 1 && fields[0].empty()) continue; // blank line
+        if (line == 1 && fields[0] == "id") continue;  // header
+
+        String_Entry& entry = strings.emplace_back();
+        const size_t colon = fields[0].find(':');
+        if (!valid || count != fields.size() || colon == std::string::npos ||
+            !parse_hex(std::string_view{fields[0]}.substr(0, colon), entry.offset) ||
+            !parse_hex(std::string_view{fields[0]}.substr(colon + 1), entry.argument)) {
+            fail("Bad string table entry on line %d.", line);
+        }
+        entry.context = std::move(fields[1]);
+        entry.text = std::move(fields[2]);
+    }
+}
+
+Result read_string_table(std::string_view csv, std::vector<String_Entry>& strings) {
+    return capture_errors([&] { read_entries(csv, strings); });
+}
+
+static void extract_entries(std::span<const std::byte> data, std::vector<String_Entry>& strings, std::pmr::memory_resource* scratch) {
+    Header header(data);
+    Script script{scratch};
+    parse_script(data, header, script, Parse_Mode::Layout);
+
+    std::pmr::string narrow{scratch};
+    std::pmr::u16string wide{scratch};
+    for (const auto& instruction : script.instructions) {
+        u32 x = 0;
+        for (const auto& argument : script.arguments_of(instruction)) {
+            if (argument.type == 2) {
+                const size_t string_offset = header.GetLength() + (static_cast<size_t>(argument.raw_data) << 2);
+                String_Entry& entry = strings.emplace_back();
+                entry.offset = header.GetLength() + (instruction.offset << 2);
+                entry.argument = x;
+                entry.context = instruction.definition->label;
+
+                narrow.clear();
+                wide.clear();
+                bool terminated;
+                if (header.IsVer5()) {
+                    terminated = decode_pool_string(data, string_offset, wide);
+                    utf16_to_utf8(wide, entry.text);
+                } else {
+                    terminated = decode_pool_string(data, string_offset, narrow);
+                    cp932_to_utf8(narrow, entry.text);
+                }
+                if (!terminated) {
+                    fail("Unterminated string at 0x%zx", string_offset);
+                }
+            }
+            x++;
+        }
+    }
+}
+
+Result extract_strings(std::span<const std::byte> data, std::vector<String_Entry>& strings, std::pmr::memory_resource* scratch) {
+    return capture_errors([&] { extract_entries(data, strings, scratch); });
+}
+
+static u64 string_key(u32 offset, u32 argument) {
+    return (static_cast<u64>(offset) << 32) | argument;
+}
+
+template <typename T>
+static inline char* put(char* out, const T& value) {
+    std::memcpy(out, &value, sizeof(value));
+    return out + sizeof(value);
+}
+
+static size_t patch_script(std::span<const std::byte> original, std::span<const String_Entry> replacements, Output_Buffer& output,
+                           std::vector<const String_Entry*>& unmatched, std::pmr::memory_resource* scratch) {
+    Header header(original);
+    Script script{scratch};
+    parse_script(original, header, script, Parse_Mode::Layout);
+
+    auto& binary_header{header.GetHeader()};
+    const u32 header_length = header.GetLength();
+
+    // Instruction offsets never move, only what follows the last instruction does
+    u32 instructions_end = header_length;
+    if (!script.instructions.empty()) {
+        const Instruction& last = script.instructions.back();
+        instructions_end += (last.offset << 2) + op_code_info(last.definition->op_code).length;
+    }
+
+    // Replacement by id, and whether an argument was found for it
+    std::pmr::unordered_map<u64, std::pair<const String_Entry*, bool>> by_id{scratch};
+    for (const auto& entry : replacements) {
+        by_id[string_key(entry.offset, entry.argument)] = {&entry, false};
+    }
+
+    // Rebuild the pool in instruction order, the way assemble() lays it out. Strings which aren't replaced are
+    // decoded and encoded again in their original encoding, never converted.
+    std::pmr::string pool{scratch};
+    std::pmr::vector<u32> footer{scratch};
+    std::pmr::vector<std::pair<u32, u32>> array_arguments{scratch}; // argument index, position in the footer
+    std::pmr::string narrow{scratch};
+    std::pmr::u16string wide{scratch};
+    size_t replaced = 0;
+
+    for (const auto& instruction : script.instructions) {
+        const u32 offset = header_length + (instruction.offset << 2);
+        u32 x = 0;
+        for (auto& argument : script.arguments_of(instruction)) {
+            if (argument.type == 2) {
+                const size_t string_offset = header_length + (static_cast<size_t>(argument.raw_data) << 2);
+                const auto it = by_id.find(string_key(offset, x));
+
+                narrow.clear();
+                wide.clear();
+                bool terminated = true;
+                if (it != by_id.end()) {
+                    const std::string& text = it->second.first->text;
+                    header.IsVer5() ? utf8_to_utf16(text, wide) : utf8_to_cp932(text, narrow);
+                    it->second.second = true;
+                    replaced++;
+                } else {
+                    terminated = header.IsVer5() ? decode_pool_string(original, string_offset, wide)
+                                                 : decode_pool_string(original, string_offset, narrow);
+                }
+                if (!terminated) {
+                    fail("Unterminated string at 0x%zx", string_offset);
+                }
+
+                argument.raw_data = (instructions_end + static_cast<u32>(pool.size()) - header_length) >> 2;
+                header.IsVer5() ? encode_pool_string(wide, pool) : encode_pool_string(narrow, pool);
+            } else if (instruction.definition->op_code == 0x64 && x == 1 && argument.type == 0) {
+                // Arrays are copied to the footer in the same order, their offsets are known once the pool is complete
+                const size_t array_offset = header_length + (static_cast<size_t>(argument.raw_data) << 2);
+                const u32 length = read_value<u32>(original, array_offset);
+                array_arguments.emplace_back(static_cast<u32>(&argument - script.arguments.data()), static_cast<u32>(footer.size()));
+                footer.push_back(length);
+                for (u32 i = 0; i < length; i++) {
+                    footer.push_back(read_value<u32>(original, array_offset + sizeof(u32) * (i + 1)));
+                }
+            }
+            x++;
+        }
+    }
+
+    for (const auto& entry : replacements) {
+        if (!by_id[string_key(entry.offset, entry.argument)].second) {
+            unmatched.push_back(&entry);
+        }
+    }
+
+    const u32 arrays_start = (instructions_end + static_cast<u32>(pool.size()) - header_length) >> 2;
+    for (const auto& [index, position] : array_arguments) {
+        script.arguments[index].raw_data = arrays_start + position;
+    }
+
+    // The op code tables only hold instruction offsets, which didn't change
+    const auto copy_table = [&](u32 table_offset, u32 table_length) {
+        const u32 new_offset = arrays_start + static_cast<u32>(footer.size());
+        for (u32 i = 0; i < table_length; i++) {
+            footer.push_back(read_value<u32>(original, header_length + ((static_cast<size_t>(table_offset) + i) << 2)));
+        }
+        return new_offset;
+    };
+    binary_header.table_1_offset = copy_table(binary_header.table_1_offset, binary_header.table_1_length);
+    binary_header.table_2_offset = copy_table(binary_header.table_2_offset, binary_header.table_2_length);
+    binary_header.table_3_offset = copy_table(binary_header.table_3_offset, binary_header.table_3_length);
+
+    // Header and instructions as they were, with the moved offsets patched in
+    const size_t file_size = instructions_end + pool.size() + footer.size() * sizeof(u32);
+    char* const start = output.extend(file_size);
+    std::memcpy(start, original.data(), instructions_end);
+
+    // The table fields sit at the end of the header in both versions
+    constexpr size_t TABLES_SIZE = sizeof(BinaryHeader) - offsetof(BinaryHeader, table_1_length);
+    std::memcpy(start + header_length - TABLES_SIZE, &binary_header.table_1_length, TABLES_SIZE);
+
+    for (const auto& instruction : script.instructions) {
+        char* out = start + header_length + (instruction.offset << 2) + sizeof(u32);
+        for (const auto& argument : script.arguments_of(instruction)) {
+            out = put(out + sizeof(u32), argument.raw_data);
+        }
+    }
+
+    char* out = start + instructions_end;
+    std::memcpy(out, pool.data(), pool.size());
+    out += pool.size();
+    std::memcpy(out, footer.data(), footer.size() * sizeof(u32));
+
+    return replaced;
+}
+
+Result patch_strings(std::span<const std::byte> original, std::span<const String_Entry> replacements, Output_Buffer& output,
+                     size_t& replaced, std::vector<const String_Entry*>& unmatched, std::pmr::memory_resource* scratch) {
+    const size_t start = output.size();
+    const size_t unmatched_start = unmatched.size();
+    replaced = 0;
+    Result result = capture_errors([&] { replaced = patch_script(original, replacements, output, unmatched, scratch); });
+    if (!result) {
+        output.truncate(start);
+        unmatched.resize(unmatched_start);
+    }
+    return result;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "age-error.h"
+#include "output-buffer.h"
+#include "types.h"
+
+// A string argument of a script, identified by where it sits rather than by what it says
+struct String_Entry {
+    u32 offset;          // byte offset of the instruction in the script
+    u32 argument;        // index of the argument within the instruction
+    std::string context; // mnemonic of the instruction, e.g. show-text
+    std::string text;    // UTF8
+};
+
+// String tables are CSV with an "id,context,text" header line, ids look like 0000a3f0:1 (instruction offset:argument).
+// Fields holding commas, quotes or line breaks are quoted, with "" standing for a quote.
+void write_string_table(std::span<const String_Entry> strings, Output_Buffer& output);
+// Appends the entries of csv to strings, failing on the first malformed line
+Result read_string_table(std::string_view csv, std::vector<String_Entry>& strings);
+
+// Appends every string argument of a compiled script to strings, in instruction order. Only the instruction stream is
+// parsed, nothing is formatted as text.
+Result extract_strings(std::span<const std::byte> script, std::vector<String_Entry>& strings,
+                     std::pmr::memory_resource* scratch = std::pmr::get_default_resource());
+
+// Rebuilds a script with some of its strings replaced, without going through text : the instruction stream is copied as is
+// apart from the string and array arguments, whose offsets are patched in place. The string pool is rebuilt, the arrays and
+// op code tables are copied after it and their offsets updated in the header. replaced is set to how many strings were,
+// and the replacements whose id matches no string argument are appended to unmatched, in table order.
+// On failure nothing is appended to output.
+Result patch_strings(std::span<const std::byte> original, std::span<const String_Entry> replacements, Output_Buffer& output,
+                     size_t& replaced, std::vector<const String_Entry*>& unmatched,
+                     std::pmr::memory_resource* scratch = std::pmr::get_default_resource());
@@ -0,0 +1,123 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <utility>
+
+static std::atomic<u64> next_recorder_id{1};
+
+Trace_Recorder::Trace_Recorder(size_t spans_per_thread) :
+    m_id(next_recorder_id.fetch_add(1, std::memory_order_relaxed)), m_capacity(std::max<size_t>(spans_per_thread, 1)), m_epoch(std::chrono::steady_clock::now()) {
+}
+
+Trace_Recorder::~Trace_Recorder() {
+    Thread_Buffer* buffer = m_buffers.load(std::memory_order_acquire);
+    while (buffer) {
+        delete std::exchange(buffer, buffer->next);
+    }
+}
+
+Trace_Recorder::Thread_Buffer& Trace_Recorder::buffer() {
+    // The buffer of this thread, registered the first time it records anything
+    thread_local u64 owner = 0;
+    thread_local Thread_Buffer* current = nullptr;
+    if (owner == m_id) {
+        return *current;
+    }
+
+    auto* buffer = new Thread_Buffer;
+    buffer->spans = std::make_unique<Span[]>(m_capacity);
+    buffer->thread = m_thread_count.fetch_add(1, std::memory_order_relaxed) + 1;
+    buffer->next = m_buffers.load(std::memory_order_relaxed);
+    while (!m_buffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+
+    owner = m_id;
+    current = buffer;
+    return *buffer;
+}
+
+void Trace_Recorder::record(std::string_view name, const std::filesystem::path* file, std::chrono::steady_clock::time_point start,
+                            std::chrono::steady_clock::time_point end) {
+    Thread_Buffer& buffer = this->buffer();
+    const u64 written = buffer.written.load(std::memory_order_relaxed);
+    buffer.spans[written % m_capacity] = {
+        name,
+        file,
+        static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(start - m_epoch).count()),
+        static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()),
+    };
+    buffer.written.store(written + 1, std::memory_order_release);
+}
+
+void Trace_Recorder::phase_done(Stats_Phase phase, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    // Strings are timed one by one, as spans they would only bury the decode span they sit in
+    if (phase == Stats_Phase::Transcode) return;
+    record(stats_phase_name(phase), nullptr, start, end);
+}
+
+static void append_json_string(std::string_view text, std::string& output) {
+    output.push_back('"');
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            output.push_back('\\');
+        }
+        if (static_cast<unsigned char>(c) >= 0x20) {
+            output.push_back(c);
+        }
+    }
+    output.push_back('"');
+}
+
+// Trace timestamps are in microseconds, keep the nanoseconds as decimals
+static void append_microseconds(u64 nanoseconds, std::string& output) {
+    char text[32];
+    snprintf(text, sizeof(text), "%llu.%03llu", static_cast<unsigned long long>(nanoseconds / 1000),
+             static_cast<unsigned long long>(nanoseconds % 1000));
+    output.append(text);
+}
+
+bool Trace_Recorder::write(const std::filesystem::path& path) const {
+    std::string output;
+    output.append("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    bool first = true;
+    u64 dropped = 0;
+
+    for (const Thread_Buffer* buffer = m_buffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+        const std::string thread = std::to_string(buffer->thread);
+        output.append(first ? "\n" : ",\n");
+        first = false;
+        output.append("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": ").append(thread);
+        output.append(", \"args\": {\"name\": \"thread ").append(thread).append("\"}}");
+
+        const u64 written = buffer->written.load(std::memory_order_acquire);
+        const u64 begin = written > m_capacity ? written - m_capacity : 0;
+        dropped += begin;
+        for (u64 i = begin; i < written; i++) {
+            const Span& span = buffer->spans[i % m_capacity];
+            output.append(",\n{\"name\": ");
+            append_json_string(span.name, output);
+            output.append(", \"cat\": \"").append(span.file ? "file" : "phase").append("\", \"ph\": \"X\", \"ts\": ");
+            append_microseconds(span.start, output);
+            output.append(", \"dur\": ");
+            append_microseconds(span.duration, output);
+            output.append(", \"pid\": 1, \"tid\": ").append(thread);
+            if (span.file) {
+                output.append(", \"args\": {\"file\": ");
+                append_json_string(span.file->generic_string(), output);
+                output.push_back('}');
+            }
+            output.push_back('}');
+        }
+    }
+
+    output.append("\n], \"otherData\": {\"dropped_spans\": ").append(std::to_string(dropped)).append("}}\n");
+    if (dropped > 0) {
+        fprintf(stderr, "Trace buffers overflowed, the oldest %llu spans were dropped\n", static_cast<unsigned long long>(dropped));
+    }
+
+    std::ofstream fd_out(path, std::ios::out | std::ios::binary);
+    return static_cast<bool>(fd_out.write(output.data(), output.size()));
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+#include "script-stats.h"
+#include "types.h"
+
+// Records spans of every thread which touches it, and writes them out in the Chrome trace event format (chrome://tracing, Perfetto).
+// Each thread appends to a ring buffer of its own, so recording takes no lock; once a buffer is full the oldest spans are overwritten.
+// Buffers are only read by write(), after the recording threads are done.
+class Trace_Recorder : public Phase_Listener {
+public:
+    explicit Trace_Recorder(size_t spans_per_thread = 1 << 16);
+    ~Trace_Recorder() override;
+
+    Trace_Recorder(const Trace_Recorder&) = delete;
+    Trace_Recorder& operator=(const Trace_Recorder&) = delete;
+
+    // name must outlive the recorder, file may be nullptr
+    void record(std::string_view name, const std::filesystem::path* file, std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::time_point end);
+
+    void phase_done(Stats_Phase phase, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) override;
+
+    bool write(const std::filesystem::path& path) const;
+
+private:
+    struct Span {
+        std::string_view name;
+        const std::filesystem::path* file;
+        u64 start; // nanoseconds since the recorder was created
+        u64 duration;
+    };
+
+    struct Thread_Buffer {
+        std::unique_ptr<Span[]> spans;
+        std::atomic<u64> written{0};
+        u32 thread{};
+        Thread_Buffer* next{};
+    };
+
+    Thread_Buffer& buffer();
+
+    // Tells the thread local buffers of different recorders apart, even at the same address
+    const u64 m_id;
+    const size_t m_capacity;
+    const std::chrono::steady_clock::time_point m_epoch;
+    std::atomic<Thread_Buffer*> m_buffers{nullptr};
+    std::atomic<u32> m_thread_count{0};
+};
+
+// Records the time until it is destroyed as one span, does nothing without a recorder
+class Trace_Span {
+public:
+    Trace_Span(Trace_Recorder* recorder, std::string_view name, const std::filesystem::path* file = nullptr) :
+        m_recorder(recorder), m_name(name), m_file(file) {
+        if (m_recorder) m_start = std::chrono::steady_clock::now();
+    }
+
+    ~Trace_Span() {
+        if (m_recorder) m_recorder->record(m_name, m_file, m_start, std::chrono::steady_clock::now());
+    }
+
+    Trace_Span(const Trace_Span&) = delete;
+    Trace_Span& operator=(const Trace_Span&) = delete;
+
+private:
+    Trace_Recorder* m_recorder;
+    std::string_view m_name;
+    const std::filesystem::path* m_file;
+    std::chrono::steady_clock::time_point m_start;
+};
@@ -0,0 +1,287 @@
+#include "transcode.h"
+#include "cp932-table.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+static constexpr u32 CP932_BAD_CHARACTER = 0x30FB;
+static constexpr u32 REPLACEMENT_CHARACTER = 0xFFFD;
+
+// UTF-8 bytes of a BMP code point packed little-endian in the low 24 bits, with the byte count in the top 8 bits.
+static constexpr u32 pack_utf8(u32 cp) {
+    if (cp < 0x80) {
+        return (1u << 24) | cp;
+    } else if (cp < 0x800) {
+        return (2u << 24) | (0xC0 | (cp >> 6)) | ((0x80 | (cp & 0x3F)) << 8);
+    }
+    return (3u << 24) | (0xE0 | (cp >> 12)) | ((0x80 | ((cp >> 6) & 0x3F)) << 8) | ((0x80 | (cp & 0x3F)) << 16);
+}
+
+template <size_t N>
+static consteval std::array<u32, N> make_utf8_table(const std::array<u16, N>& table) {
+    std::array<u32, N> packed{};
+    for (size_t i = 0; i < N; i++) {
+        // Lead bytes in the single byte table are never looked up, unmapped pairs decode to the Win32 default
+        packed[i] = pack_utf8(table[i] == 0 && i != 0 ? CP932_BAD_CHARACTER : table[i]);
+    }
+    return packed;
+}
+
+static constexpr auto cp932_single_utf8 = make_utf8_table(cp932_single_byte);
+static constexpr auto cp932_double_utf8 = make_utf8_table(cp932_double_byte);
+
+static inline char* put_utf8(char* out, u32 packed) {
+    const u32 length = packed >> 24;
+    out[0] = static_cast<char>(packed);
+    out[1] = static_cast<char>(packed >> 8);
+    out[2] = static_cast<char>(packed >> 16);
+    return out + length;
+}
+
+static inline char* put_utf8_code_point(char* out, u32 cp) {
+    if (cp < 0x10000) {
+        return put_utf8(out, pack_utf8(cp));
+    }
+    out[0] = static_cast<char>(0xF0 | (cp >> 18));
+    out[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = static_cast<char>(0x80 | (cp & 0x3F));
+    return out + 4;
+}
+
+// Copies the leading run of ASCII bytes, 16 (or 8) at a time, and returns how many were copied.
+static inline size_t copy_ascii(const u8* in, size_t size, char* out) {
+    size_t pos = 0;
+#ifdef AGE_HAVE_SSE2
+    while (size - pos >= 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + pos));
+        const u32 mask = static_cast<u32>(_mm_movemask_epi8(block));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + pos), block);
+        if (mask != 0) {
+            return pos + std::countr_zero(mask);
+        }
+        pos += 16;
+    }
+#else
+    while (size - pos >= 8) {
+        u64 word;
+        std::memcpy(&word, in + pos, sizeof(word));
+        const u64 mask = word & 0x8080808080808080ull;
+        std::memcpy(out + pos, &word, sizeof(word));
+        if (mask != 0) {
+            return pos + (std::countr_zero(mask) >> 3);
+        }
+        pos += 8;
+    }
+#endif
+    while (pos < size && in[pos] < 0x80) {
+        out[pos] = static_cast<char>(in[pos]);
+        pos++;
+    }
+    return pos;
+}
+
+// Decodes one UTF-8 sequence, always advancing by at least a byte. Malformed input yields U+FFFD.
+static inline u32 decode_utf8(const u8*& in, const u8* end) {
+    const u32 lead = *in++;
+    if (lead < 0x80) {
+        return lead;
+    }
+
+    u32 length, cp, min;
+    if ((lead & 0xE0) == 0xC0) {
+        length = 1, cp = lead & 0x1F, min = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+        length = 2, cp = lead & 0x0F, min = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+        length = 3, cp = lead & 0x07, min = 0x10000;
+    } else {
+        return REPLACEMENT_CHARACTER;
+    }
+
+    if (static_cast<size_t>(end - in) < length) {
+        in = end;
+        return REPLACEMENT_CHARACTER;
+    }
+    for (u32 i = 0; i < length; i++) {
+        if ((in[i] & 0xC0) != 0x80) {
+            in += i;
+            return REPLACEMENT_CHARACTER;
+        }
+        cp = (cp << 6) | (in[i] & 0x3F);
+    }
+    in += length;
+
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        return REPLACEMENT_CHARACTER;
+    }
+    return cp;
+}
+
+template <typename String>
+static void cp932_to_utf8_into(std::string_view input, String& output) {
+    const size_t start = output.size();
+    // Every CP932 byte expands to at most 3 UTF-8 bytes
+    output.resize(start + input.size() * 3);
+
+    const u8* in = reinterpret_cast<const u8*>(input.data());
+    const u8* end = in + input.size();
+    char* out = output.data() + start;
+
+    while (in < end) {
+        const size_t ascii = copy_ascii(in, end - in, out);
+        in += ascii;
+        out += ascii;
+        if (in == end) break;
+
+        const u8 c = *in++;
+        const s32 row = cp932_lead_row(c);
+        if (row < 0) {
+            out = put_utf8(out, cp932_single_utf8[c]);
+            continue;
+        }
+
+        if (in == end || *in < CP932_TRAIL_FIRST || *in >= CP932_TRAIL_FIRST + CP932_TRAIL_COUNT) {
+            out = put_utf8(out, pack_utf8(CP932_BAD_CHARACTER));
+            continue;
+        }
+        out = put_utf8(out, cp932_double_utf8[row * CP932_TRAIL_COUNT + (*in++ - CP932_TRAIL_FIRST)]);
+    }
+
+    output.resize(out - output.data());
+}
+
+template <typename String>
+static void utf8_to_cp932_into(std::string_view input, String& output) {
+    const size_t start = output.size();
+    // CP932 is never longer than the UTF-8 it came from
+    output.resize(start + input.size());
+
+    const u8* in = reinterpret_cast<const u8*>(input.data());
+    const u8* end = in + input.size();
+    char* out = output.data() + start;
+
+    while (in < end) {
+        const size_t ascii = copy_ascii(in, end - in, out);
+        in += ascii;
+        out += ascii;
+        if (in == end) break;
+
+        const u32 cp = decode_utf8(in, end);
+        const u16 encoded = cp <= 0xFFFF ? cp932_reverse_rows[cp932_reverse_page[cp >> 8] * 0x100 + (cp & 0xFF)] : 0;
+        if (encoded == 0) {
+            *out++ = '?';
+        } else if (encoded > 0xFF) {
+            *out++ = static_cast<char>(encoded >> 8);
+            *out++ = static_cast<char>(encoded);
+        } else {
+            *out++ = static_cast<char>(encoded);
+        }
+    }
+
+    output.resize(out - output.data());
+}
+
+template <typename String>
+static void utf16_to_utf8_into(std::u16string_view input, String& output) {
+    const size_t start = output.size();
+    // Every UTF-16 code unit expands to at most 3 UTF-8 bytes, surrogate pairs to 4
+    output.resize(start + input.size() * 3);
+
+    const char16_t* in = input.data();
+    const char16_t* end = in + input.size();
+    char* out = output.data() + start;
+
+    while (in < end) {
+#ifdef AGE_HAVE_SSE2
+        while (end - in >= 8) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+            const __m128i high = _mm_and_si128(block, _mm_set1_epi16(static_cast<short>(0xFF80)));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xFFFF) {
+                break;
+            }
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(block, block));
+            in += 8;
+            out += 8;
+        }
+        if (in == end) break;
+#endif
+
+        u32 cp = *in++;
+        if (cp >= 0xD800 && cp <= 0xDBFF && in < end && *in >= 0xDC00 && *in <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (*in++ - 0xDC00);
+        } else if (cp >= 0xD800 && cp <= 0xDFFF) {
+            cp = REPLACEMENT_CHARACTER;
+        }
+        out = put_utf8_code_point(out, cp);
+    }
+
+    output.resize(out - output.data());
+}
+
+template <typename String>
+static void utf8_to_utf16_into(std::string_view input, String& output) {
+    const size_t start = output.size();
+    // Never more UTF-16 code units than UTF-8 bytes
+    output.resize(start + input.size());
+
+    const u8* in = reinterpret_cast<const u8*>(input.data());
+    const u8* end = in + input.size();
+    char16_t* out = output.data() + start;
+
+    while (in < end) {
+#ifdef AGE_HAVE_SSE2
+        while (end - in >= 16) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+            if (_mm_movemask_epi8(block) != 0) {
+                break;
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(block, _mm_setzero_si128()));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpackhi_epi8(block, _mm_setzero_si128()));
+            in += 16;
+            out += 16;
+        }
+        if (in == end) break;
+#endif
+
+        const u32 cp = decode_utf8(in, end);
+        if (cp >= 0x10000) {
+            *out++ = static_cast<char16_t>(0xD800 + ((cp - 0x10000) >> 10));
+            *out++ = static_cast<char16_t>(0xDC00 + ((cp - 0x10000) & 0x3FF));
+        } else {
+            *out++ = static_cast<char16_t>(cp);
+        }
+    }
+
+    output.resize(out - output.data());
+}
+
+void cp932_to_utf8(std::string_view input, std::string& output) {
+    cp932_to_utf8_into(input, output);
+}
+void cp932_to_utf8(std::string_view input, std::pmr::string& output) {
+    cp932_to_utf8_into(input, output);
+}
+
+void utf8_to_cp932(std::string_view input, std::string& output) {
+    utf8_to_cp932_into(input, output);
+}
+void utf8_to_cp932(std::string_view input, std::pmr::string& output) {
+    utf8_to_cp932_into(input, output);
+}
+
+void utf16_to_utf8(std::u16string_view input, std::string& output) {
+    utf16_to_utf8_into(input, output);
+}
+void utf16_to_utf8(std::u16string_view input, std::pmr::string& output) {
+    utf16_to_utf8_into(input, output);
+}
+
+void utf8_to_utf16(std::string_view input, std::u16string& output) {
+    utf8_to_utf16_into(input, output);
+}
+void utf8_to_utf16(std::string_view input, std::pmr::u16string& output) {
+    utf8_to_utf16_into(input, output);
+}
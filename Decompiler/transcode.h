@@ -0,0 +1,19 @@
+#pragma once
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+#include "types.h"
+
+// Portable, table-driven replacements for the Win32 code page conversions.
+// Every function appends to output, so callers can reuse their buffers between strings. Each has an overload for the pmr strings used with scratch arenas.
+// Bad CP932 sequences become U+30FB and bad UTF-8/UTF-16 U+FFFD, like Win32. Characters CP932 lacks become '?' : unlike
+// WideCharToMultiByte without WC_NO_BEST_FIT_CHARS there is no best-fit mapping, e.g. U+00A5 is not turned into 0x5C.
+void cp932_to_utf8(std::string_view input, std::string& output);
+void cp932_to_utf8(std::string_view input, std::pmr::string& output);
+void utf8_to_cp932(std::string_view input, std::string& output);
+void utf8_to_cp932(std::string_view input, std::pmr::string& output);
+void utf16_to_utf8(std::u16string_view input, std::string& output);
+void utf16_to_utf8(std::u16string_view input, std::pmr::string& output);
+void utf8_to_utf16(std::string_view input, std::u16string& output);
+void utf8_to_utf16(std::string_view input, std::pmr::u16string& output);
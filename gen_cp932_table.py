@@ -0,0 +1,102 @@
+# Generates Decompiler/cp932-table.h from Python's cp932 codec, which follows the Windows code page 932 tables
+# (including the NEC/IBM duplicate preferences used when encoding).
+from pathlib import Path
+
+LEADS = list(range(0x81, 0xA0)) + list(range(0xE0, 0xFD))
+TRAILS = list(range(0x40, 0xFD))
+
+
+def single_byte():
+    table = []
+    for b in range(0x100):
+        if b in LEADS:
+            table.append(0xFFFF)
+        else:
+            table.append(ord(bytes([b]).decode("cp932")))
+    return table
+
+
+def double_byte():
+    table = []
+    for lead in LEADS:
+        for trail in TRAILS:
+            try:
+                table.append(ord(bytes([lead, trail]).decode("cp932")))
+            except UnicodeDecodeError:
+                table.append(0)
+    return table
+
+
+def reverse(single, double):
+    chars = {c for c in single + double if c not in (0, 0xFFFF) and c >= 0x80}
+    entries = []
+    for c in sorted(chars):
+        encoded = chr(c).encode("cp932")
+        entries.append((c, int.from_bytes(encoded, "big")))
+    return entries
+
+
+def reverse_pages(entries):
+    """Two level lookup : a row per high byte of the code unit, rows without any mapping share the empty row 0."""
+    pages = [[0] * 0x100]
+    page_of = [0] * 0x100
+    for c, encoded in entries:
+        high = c >> 8
+        if page_of[high] == 0:
+            page_of[high] = len(pages)
+            pages.append([0] * 0x100)
+        pages[page_of[high]][c & 0xFF] = encoded
+    return page_of, [v for page in pages for v in page], len(pages)
+
+
+def rows(values, fmt, per_row):
+    out = []
+    for i in range(0, len(values), per_row):
+        out.append("    " + " ".join(fmt(v) + "," for v in values[i:i + per_row]))
+    return "\n".join(out)
+
+
+single = single_byte()
+double = double_byte()
+rev = reverse(single, double)
+page_of, page_rows, page_count = reverse_pages(rev)
+
+header = f"""#pragma once
+// Generated by gen_cp932_table.py, do not edit.
+#include <array>
+
+#include "types.h"
+
+// UTF-16 code unit for every single byte. Lead bytes of double-byte characters hold 0xFFFF.
+inline constexpr std::array<u16, 0x100> cp932_single_byte{{{{
+{rows(single, lambda v: f"0x{v:04X}", 16)}
+}}}};
+
+inline constexpr u32 CP932_TRAIL_FIRST = 0x{TRAILS[0]:02X};
+inline constexpr u32 CP932_TRAIL_COUNT = {len(TRAILS)};
+
+// Index of a lead byte into cp932_double_byte rows, -1 when the byte is not a lead byte.
+inline constexpr s32 cp932_lead_row(u8 lead) {{
+    if (lead >= 0x81 && lead <= 0x9F) return lead - 0x81;
+    if (lead >= 0xE0 && lead <= 0xFC) return lead - 0xE0 + 0x1F;
+    return -1;
+}}
+
+// UTF-16 code unit for every lead/trail pair, {len(LEADS)} rows of {len(TRAILS)} trail bytes. Unmapped pairs hold 0.
+inline constexpr std::array<u16, {len(double)}> cp932_double_byte{{{{
+{rows(double, lambda v: f"0x{v:04X}", 16)}
+}}}};
+
+// Preferred encoding of every non-ASCII character, {len(rev)} of them, looked up in two levels :
+// cp932_reverse_rows[cp932_reverse_page[c >> 8] * 0x100 + (c & 0xFF)]. Single-byte encodings are stored as-is, double-byte
+// ones as (lead << 8) | trail, and 0 means the character has none. Pages without any character share the empty row 0.
+inline constexpr std::array<u8, 0x100> cp932_reverse_page{{{{
+{rows(page_of, lambda v: f"0x{v:02X}", 16)}
+}}}};
+
+inline constexpr std::array<u16, {page_count} * 0x100> cp932_reverse_rows{{{{
+{rows(page_rows, lambda v: f"0x{v:04X}", 16)}
+}}}};
+"""
+
+Path(__file__).parent.joinpath("Decompiler", "cp932-table.h").write_bytes(header.replace("\n", "\r\n").encode("ascii"))